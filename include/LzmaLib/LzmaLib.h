@@ -6,18 +6,27 @@
 
 #include <LzmaLib/Types.h>
 
+#ifndef WINAPI
+#define WINAPI
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 #define LZMA_PROPS_SIZE 5
 
+/* The first props byte of the data that is stored without compression
+   (LzmaCompressMt blocks, lzma.h/lzma.hpp helpers). It's never written by the encoder. */
+#define LZMA_PROPS_STORED 0xFF
+
 /*
 RAM requirements for LZMA:
   for compression:   (dictSize * 11.5 + 6 MB) + state_size
   for decompression: dictSize + state_size
     state_size = (4 + (1.5 << (lc + lp))) KB
     by default (lc=3, lp=0), state_size = 16 KB.
+  LzmaCompressMemUsage and LzmaUncompressMemUsage return the exact numbers.
 
 LZMA properties (5 bytes) format
     Offset Size  Description
@@ -60,6 +69,10 @@ dictSize - The dictionary size in bytes. The maximum value is
      The default value is 16 MB = (1 << 24) bytes.
      It's recommended to use the dictionary that is larger than 4 KB and
      that can be calculated as (1 << N) or (3 << N) sizes.
+     If dictSize is larger than srcLen, the encoder reduces it to the smallest
+     (2 << N) or (3 << N) size (but not less than 4 KB) that covers srcLen,
+     so small inputs don't pay for big match finder tables. The reduced
+     value is written to outProps.
 
 lc - The number of literal context bits (high bits of previous literal).
      It can be in the range from 0 to 8. The default value is 3.
@@ -80,8 +93,13 @@ fb - Word size (the number of fast bytes).
      Usually, a big number gives a little bit better compression ratio and
      slower compression process.
 
-numThreads - The number of thereads. 1 or 2. The default value is 2.
+numThreads - The number of thereads. 1 <= numThreads <= 16. The default value is 2.
      Fast mode (algo = 0) can use only 1 thread.
+     numThreads = 2: the hash and the binary tree match finder threads.
+     numThreads > 2: the binary tree work is split across (numThreads - 1)
+       threads. The match finder doesn't check the last min(4 KB, dictSize / 16)
+       bytes of the dictionary in that mode, so the compression ratio can be
+       a little worse.
 
 Out:
   destLen  - processed output size
@@ -101,9 +119,487 @@ int WINAPI LzmaCompress(unsigned char *dest, size_t *destLen, const unsigned cha
   int lp,        /* 0 <= lp <= 4, default = 0  */
   int pb,        /* 0 <= pb <= 4, default = 2  */
   int fb,        /* 5 <= fb <= 273, default = 32 */
-  int numThreads /* 1 or 2, default = 2 */
+  int numThreads /* 1 <= numThreads <= 16, default = 2 */
   );
 
+/*
+LzmaCompressEx
+--------------
+  The same as LzmaCompress, but the memory is allocated from (alloc) and
+  (allocBig). allocBig gets the big buffers of the match finder (the hash
+  table, the binary tree, the buffers of the multithreaded match finder),
+  alloc gets all other blocks. NULL means the default allocator (malloc,
+  and BigAlloc with large pages for allocBig, see LzmaSetLargePages).
+  The allocators are called only in the calling thread (also with
+  numThreads > 1), so a per-thread arena doesn't need a lock.
+*/
+
+int WINAPI LzmaCompressEx(unsigned char *dest, size_t *destLen, const unsigned char *src, size_t srcLen,
+  unsigned char *outProps, size_t *outPropsSize,
+  int level, unsigned dictSize, int lc, int lp, int pb, int fb, int numThreads,
+  ISzAlloc *alloc, ISzAlloc *allocBig);
+
+/*
+LzmaEncoderContext
+------------------
+  The context keeps the encoder and its buffers (match finder, range coder,
+  literal probabilities) between LzmaCompressWithContext calls. The buffers
+  are reallocated only if new parameters require other sizes. The state of
+  the encoder is reset for each call, so each call writes separate stream,
+  the same as LzmaCompress.
+  Don't use one context in several threads at the same time.
+
+LzmaEncoderContext_Create returns NULL in case of memory allocation error.
+*/
+
+typedef void * LzmaEncoderContext;
+
+LzmaEncoderContext WINAPI LzmaEncoderContext_Create(void);
+void WINAPI LzmaEncoderContext_Destroy(LzmaEncoderContext ctx);
+
+/*
+LzmaCompressMemUsage
+--------------------
+  Returns the number of bytes that the encoder allocates for these parameters
+  (the same as in LzmaCompress). It's for the functions that read src
+  directly (LzmaCompress*, LzmaCompressFile of a regular file). The stream
+  encoder (LzmaCompressStreamBegin, LzmaCompressFile of a pipe) also
+  allocates the input window (about dictSize * 1.5).
+  Returns 0, if lc or lp is incorrect.
+
+LzmaEncoderContext_SetMemLimit
+------------------------------
+  Sets the memory limit for the next calls with ctx (0 - no limit, default).
+  If the memory for the requested parameters (LzmaCompressMemUsage, plus the
+  input window for the stream encoder, plus the message buffer of
+  LzmaCompressWithDict) is larger than the limit, the encoder uses one
+  thread, and then it halves dictSize (down to 4 KB) until the estimate
+  fits. The stored props contain the reduced dictSize. If it doesn't fit
+  with the minimal settings, the call returns SZ_ERROR_MEM.
+*/
+
+UInt64 WINAPI LzmaCompressMemUsage(size_t srcLen,
+  int level, unsigned dictSize, int lc, int lp, int pb, int fb, int numThreads);
+void WINAPI LzmaEncoderContext_SetMemLimit(LzmaEncoderContext ctx, UInt64 memLimit);
+
+/*
+LzmaCompressWithContext
+-----------------------
+  The same as LzmaCompress, but it uses the encoder from ctx.
+  If ctx is NULL, it works as LzmaCompress.
+*/
+
+int WINAPI LzmaCompressWithContext(LzmaEncoderContext ctx,
+  unsigned char *dest, size_t *destLen, const unsigned char *src, size_t srcLen,
+  unsigned char *outProps, size_t *outPropsSize,
+  int level, unsigned dictSize, int lc, int lp, int pb, int fb, int numThreads);
+
+/*
+LzmaCompressStreamBegin / LzmaCompressStreamCode
+------------------------------------------------
+  Push mode stream encoder for the input that comes in parts (see
+  lzma::ostreambuf in lzma.hpp). The stream has the end mark, the encoder
+  uses one thread. Memory doesn't depend on the size of the stream. Where
+  the system allows it (Linux, Windows), the window of the encoder is a ring
+  buffer mapped twice, so the dictionary is never moved in memory.
+
+  LzmaCompressStreamBegin prepares the encoder of ctx (must not be NULL)
+  and returns the props (as in LzmaCompress). Then the encoder reads the
+  input from inStream and writes the packed data to outStream.
+
+  LzmaCompressStreamCode(ctx, inSize, finish):
+    inSize - the total number of bytes that inStream got from the caller so far
+    finish - 0: it encodes while more than LZMA_STREAM_LOOKAHEAD of these
+                bytes are not encoded. inStream->Read is called only when it
+                has data (it returns 0 bytes only at the end of the input).
+                After the call, less than LZMA_STREAM_LOOKAHEAD bytes are not
+                read from inStream yet, so a buffer of the caller can be reused.
+             1: it encodes the rest of inStream and writes the end of the stream.
+  Returns SZ_OK or the error code of LzmaCompress, and
+    SZ_ERROR_READ / SZ_ERROR_WRITE - error of inStream / outStream
+*/
+
+int WINAPI LzmaCompressStreamBegin(LzmaEncoderContext ctx,
+  ISeqOutStream *outStream, ISeqInStream *inStream,
+  unsigned char *outProps, size_t *outPropsSize,
+  int level, unsigned dictSize, int lc, int lp, int pb, int fb);
+int WINAPI LzmaCompressStreamCode(LzmaEncoderContext ctx, UInt64 inSize, int finish);
+
+/*
+LzmaCompressFile
+----------------
+  Compresses the file srcPath to the file destPath in the .lzma format:
+  props (LZMA_PROPS_SIZE bytes), the unpacked size (8 bytes, little endian)
+  and the stream, as "lzma e" and "xz --format=lzma" do it.
+  The source is memory-mapped (with MADV_SEQUENTIAL / FILE_FLAG_SEQUENTIAL_SCAN)
+  and the encoder reads the mapping directly, so the input is not copied and
+  the memory doesn't depend on the file size: the pages older than dictSize
+  are released on the way. The packed data goes from the encoder buffer to
+  pwrite / WriteFile, or to write if destPath is a pipe or a device. If the
+  source can't be mapped (it doesn't fit the address space, it's a pipe or
+  a device), it's read as in LzmaEnc_Encode;
+  the unpacked size of a pipe is unknown (all 0xFF) and the stream has the
+  end mark. The source must not be truncated during the call.
+  Parameters are the same as in LzmaCompress.
+
+Returns:
+  SZ_OK, the error codes of LzmaCompress, and
+  SZ_ERROR_READ  - srcPath can't be opened or read
+  SZ_ERROR_WRITE - destPath can't be created or written
+                   (then a regular file destPath is removed)
+  SZ_ERROR_PARAM - incorrect parameter, or destPath is srcPath
+*/
+
+int WINAPI LzmaCompressFile(const char *srcPath, const char *destPath,
+  int level, unsigned dictSize, int lc, int lp, int pb, int fb, int numThreads);
+
+/*
+LzmaCompressWithDict
+--------------------
+  The same as LzmaCompressWithContext, but the encoder starts with the preset
+  dictionary (dict, dictLen) in its window instead of the empty one, so small
+  messages can refer to the data that is typical for them (field names,
+  common values). The dictionary is not written to dest: the decoder must
+  get the same dictionary in LzmaUncompressWithDict.
+  Only the last dictSize bytes of dict are used. reduceSize of the encoder
+  is (srcLen + dictLen), so the default dictSize covers the dictionary.
+  The dictionary and src are copied to one buffer; ctx keeps it for the
+  next messages. ctx can be NULL.
+*/
+
+int WINAPI LzmaCompressWithDict(LzmaEncoderContext ctx,
+  unsigned char *dest, size_t *destLen, const unsigned char *src, size_t srcLen,
+  const unsigned char *dict, size_t dictLen,
+  unsigned char *outProps, size_t *outPropsSize,
+  int level, unsigned dictSize, int lc, int lp, int pb, int fb, int numThreads);
+
+/*
+LzmaTrainDict
+-------------
+  Builds a preset dictionary for LzmaCompressWithDict / LzmaUncompressWithDict
+  from the typical messages (samples). The samples are parsed by the match
+  finder of the encoder, and every byte gets the count of matches that copy
+  it into other samples. The windows of segmentSize bytes with the highest
+  counts are written to dict, the best windows are at the end of dict.
+
+In:
+  dict        - output buffer
+  dictLen     - the size of dict, the maximum size of the dictionary
+  samples     - all samples, one after another
+  sampleSizes - the sizes of numSamples samples, the total size <= 1 GB
+  segmentSize - the size of one window, >= 16. 0 means the default value = 256.
+                Use the size of typical repeated fragment (a record, a header).
+Out:
+  dictLen     - the size of the dictionary, it can be smaller than the buffer
+                (or 0) if the samples have not enough common data.
+Returns:
+  SZ_OK          - OK
+  SZ_ERROR_MEM   - Memory allocation error
+  SZ_ERROR_PARAM - Incorrect paramater
+*/
+
+int WINAPI LzmaTrainDict(unsigned char *dict, size_t *dictLen,
+  const unsigned char *samples, const size_t *sampleSizes, unsigned numSamples,
+  unsigned segmentSize /* 0 = default (256) */
+  );
+
+/*
+LzmaTrainModel
+--------------
+  Builds the snapshot of the probability model for LzmaCompressWithModel /
+  LzmaUncompressWithModel. Every LZMA stream starts with the untrained
+  probabilities, so the first hundreds of bytes are coded poorly. The model
+  is the state of the encoder after the typical message (the average over
+  the samples encoded one by one with the model), so the small messages are
+  coded as if they are continuation of the samples. Only the probabilities
+  are saved: the distances and the data of the samples are not used by
+  the messages (see LzmaCompressWithDict for that).
+
+In:
+  model       - output buffer
+  modelSize   - the size of model, at least LzmaModelSize(lc, lp)
+  modelId     - any number that identifies the model, see LzmaModelGetId
+  samples, sampleSizes, numSamples - the samples, as in LzmaTrainDict
+  level       - the level of LzmaCompressWithModel
+  lc, lp, pb  - the properties of the model and of all streams
+                written with it, -1 means the default value (3, 0, 2)
+Out:
+  modelSize   - the size of model
+Returns:
+  SZ_OK               - OK
+  SZ_ERROR_MEM        - Memory allocation error
+  SZ_ERROR_PARAM      - Incorrect paramater
+  SZ_ERROR_OUTPUT_EOF - modelSize is smaller than LzmaModelSize(lc, lp)
+
+Model format (numbers are little-endian):
+  Offset Size Description
+    0     4   signature: "LZMP"
+    4     4   model ID
+    8     1   (pb * 5 + lp) * 9 + lc, as the first byte of LZMA properties
+    9    2*N  N = 1846 + (0x300 << (lc + lp)) probabilities (16-bit each),
+              in the order of the tables of the decoder (LzmaDec.c)
+*/
+
+#define LZMA_MODEL_HEADER_SIZE 9
+
+int WINAPI LzmaTrainModel(unsigned char *model, size_t *modelSize, unsigned modelId,
+  const unsigned char *samples, const size_t *sampleSizes, unsigned numSamples,
+  int level, int lc, int lp, int pb);
+
+/* Returns the size of the model for (lc, lp) or 0, if lc or lp is incorrect. */
+
+size_t WINAPI LzmaModelSize(int lc, int lp);
+
+/* Reads the model ID. Returns SZ_OK or SZ_ERROR_DATA, if it's not a model. */
+
+int WINAPI LzmaModelGetId(const unsigned char *model, size_t modelSize, unsigned *modelId);
+
+/*
+LzmaModelLoad / LzmaModelFree
+-----------------------------
+  LzmaModelLoad checks the model (see LzmaTrainModel) and converts its
+  probabilities once for LzmaCompressWithModel / LzmaUncompressWithModel.
+  The handle is not changed by these calls, so several threads can use it
+  at the same time. LzmaModelFree(NULL) does nothing.
+Returns:
+  SZ_OK          - OK, *handle is the loaded model
+  SZ_ERROR_DATA  - model is incorrect
+  SZ_ERROR_MEM   - Memory allocation error
+*/
+
+typedef void * LzmaModel;
+
+int WINAPI LzmaModelLoad(LzmaModel *handle, const unsigned char *model, size_t modelSize);
+void WINAPI LzmaModelFree(LzmaModel handle);
+
+/*
+LzmaCompressWithModel
+---------------------
+  The same as LzmaCompressWithContext, but the encoder starts with the
+  probabilities of the loaded model instead of the default ones. lc, lp and
+  pb are taken from the model. There is no additional work per call.
+  The properties are LZMA_MODEL_PROPS_SIZE bytes: the LZMA properties and
+  the model ID (4 bytes, little-endian), so LzmaUncompressWithModel rejects
+  the data of another model. ctx can be NULL.
+Returns:
+  SZ_ERROR_PARAM - model is NULL or *outPropsSize < LZMA_MODEL_PROPS_SIZE
+  other codes are the same as in LzmaCompress
+*/
+
+#define LZMA_MODEL_PROPS_SIZE (LZMA_PROPS_SIZE + 4)
+
+int WINAPI LzmaCompressWithModel(LzmaEncoderContext ctx,
+  unsigned char *dest, size_t *destLen, const unsigned char *src, size_t srcLen,
+  LzmaModel model, unsigned char *outProps, size_t *outPropsSize,
+  int level, unsigned dictSize, int fb, int numThreads);
+
+/*
+LzmaSetLargePages
+-----------------
+  Enables (1) or disables (0) large pages for the big buffers of the encoders:
+  the hash table and the binary tree of the match finder, the buffers of the
+  multithreaded match finder. With the large dictionary the TLB misses in the
+  match finder are the main stall, large pages remove most of them.
+  It's global setting, it affects the next allocations. The buffers of the
+  encoder contexts are allocated once, so call it before creating them.
+  By default large pages are disabled. Only the blocks >= 256 KB use them.
+
+  Windows: VirtualAlloc(MEM_LARGE_PAGES). The library must be built with
+    _7ZIP_LARGE_PAGES, and the process needs "Lock pages in memory" privilege.
+  Linux: mmap(MAP_HUGETLB) from the reserved pool (vm.nr_hugepages), if the
+    pool is empty - transparent huge pages (madvise(MADV_HUGEPAGE)) for the
+    aligned block, if they are disabled - normal pages.
+
+  Returns 1, if the system supports large pages, else 0.
+
+LzmaEncoderContext_GetPages
+---------------------------
+  Returns the kind of pages (LZMA_PAGES_*) of the hash table and the binary tree
+  of the match finder of ctx (its largest buffer, allocated by the first
+  compression call with ctx) and writes the page size to *pageSize:
+    LZMA_PAGES_NORMAL      - normal pages
+    LZMA_PAGES_LARGE       - large pages are reserved for the buffer
+    LZMA_PAGES_TRANSPARENT - the kernel uses huge pages for the buffer, while
+                             it has free ones (see AnonHugePages in /proc/<pid>/smaps)
+  Returns -1 (and *pageSize = 0), if ctx has no buffer yet.
+*/
+
+#define LZMA_PAGES_NORMAL 0
+#define LZMA_PAGES_LARGE 1
+#define LZMA_PAGES_TRANSPARENT 2
+
+int WINAPI LzmaSetLargePages(int enable);
+int WINAPI LzmaEncoderContext_GetPages(LzmaEncoderContext ctx, size_t *pageSize);
+
+/*
+LzmaCompressBound
+-----------------
+  Returns the worst-case size of the data written by LzmaCompress for srcLen
+  bytes of input (properties are returned separately and are not included).
+  A dest buffer of that size never causes SZ_ERROR_OUTPUT_EOF, so the caller
+  can allocate once and encode once.
+
+  Returns 0, if the bound doesn't fit into size_t.
+*/
+
+size_t WINAPI LzmaCompressBound(size_t srcLen);
+
+/*
+LzmaIsIncompressible
+--------------------
+  Cheap pre-scan: samples up to 32 KB of src and returns 1 if the data looks
+  already compressed or encrypted (flat byte distribution and almost no
+  repeated sequences), else 0. Data smaller than 4 KB always returns 0.
+  LzmaCompressMt (for each block) and Lzma2Compress (for each 2 MB span) use
+  it to store such data without running the encoder. The samples can miss
+  the compressible parts of a large buffer, so check bounded spans.
+*/
+
+int WINAPI LzmaIsIncompressible(const unsigned char *src, size_t srcLen);
+
+/*
+LzmaCompressMt
+--------------
+  Splits src into blocks of blockSize bytes and compresses the blocks
+  independently by (numBlockThreads) threads, each with its own encoder.
+  The result is the container (not the LZMA stream), it contains all
+  properties, so there is no outProps parameter.
+
+  level, dictSize, lc, lp, pb, fb, numThreads - the same as in LzmaCompress,
+    they are used for each block. The dictionary is not larger than blockSize.
+  blockSize - the size of one block: 64 KB <= blockSize <= 1 GB.
+    0 means the default value = 16 MB.
+  numBlockThreads - the number of blocks compressed at the same time:
+    1 <= numBlockThreads <= 64. The default value (-1) is 2.
+    The total number of threads is (numBlockThreads * numThreads).
+
+  destLen must be at least LzmaCompressMtBound(srcLen, blockSize).
+
+Container format (numbers are little-endian):
+  Block (numBlocks times, in order):
+    Offset Size  Description
+      0     5    LZMA properties of the block
+      5     4    packSize - the size of LZMA data of the block
+      9     4    unpackSize - the size of the block
+     13  packSize  LZMA data (without end marker)
+    If the first props byte is LZMA_PROPS_STORED, the block is stored:
+    packSize = unpackSize and the data is the block itself. Incompressible
+    blocks (see LzmaIsIncompressible) and the blocks that LZMA expands are stored.
+  Index:
+    numBlocks * 8 bytes: packSize (4) and unpackSize (4) for each block
+  Footer (16 bytes):
+      0     8    total unpacked size
+      8     4    numBlocks
+     12     4    signature: "LZMX"
+
+Returns:
+  SZ_OK               - OK
+  SZ_ERROR_MEM        - Memory allocation error
+  SZ_ERROR_PARAM      - Incorrect paramater
+  SZ_ERROR_OUTPUT_EOF - destLen is smaller than LzmaCompressMtBound()
+  SZ_ERROR_THREAD     - errors in multithreading functions
+*/
+
+int WINAPI LzmaCompressMt(unsigned char *dest, size_t *destLen, const unsigned char *src, size_t srcLen,
+  int level, unsigned dictSize, int lc, int lp, int pb, int fb, int numThreads,
+  size_t blockSize,   /* 0 = default (1 << 24) */
+  int numBlockThreads /* 1 <= numBlockThreads <= 64, default = 2 */
+  );
+
+/*
+LzmaCompressMtBound
+-------------------
+  Returns the size of dest buffer required by LzmaCompressMt for srcLen
+  bytes of input and (blockSize). Returns 0 for incorrect blockSize or
+  if the bound doesn't fit into size_t.
+*/
+
+size_t WINAPI LzmaCompressMtBound(size_t srcLen, size_t blockSize);
+
+/*
+LzmaUncompressMt
+----------------
+  Decodes the container written by LzmaCompressMt. The blocks are decoded
+  by (numBlockThreads) threads, each with its own decoder, and every block
+  is written directly to its place in dest.
+
+In:
+  dest     - output data
+  destLen  - output data size, it must be at least the unpacked size,
+             see LzmaUncompressMtGetSize
+  src      - the container
+  srcLen   - the container size (the footer is at the end of src)
+  numBlockThreads - 1 <= numBlockThreads <= 64, default (-1) = 2
+Out:
+  destLen  - unpacked size
+Returns:
+  SZ_OK                - OK
+  SZ_ERROR_DATA        - Data error, or src is not the container
+  SZ_ERROR_MEM         - Memory allocation arror
+  SZ_ERROR_UNSUPPORTED - Unsupported properties
+  SZ_ERROR_INPUT_EOF   - src is too small
+  SZ_ERROR_OUTPUT_EOF  - dest is smaller than the unpacked size
+  SZ_ERROR_THREAD      - errors in multithreading functions
+*/
+
+int WINAPI LzmaUncompressMt(unsigned char *dest, size_t *destLen, const unsigned char *src, size_t srcLen,
+  int numBlockThreads);
+
+/*
+LzmaUncompressMtGetSize
+-----------------------
+  Reads the unpacked size from the footer of the container.
+  Returns SZ_OK, SZ_ERROR_DATA or SZ_ERROR_INPUT_EOF.
+*/
+
+int WINAPI LzmaUncompressMtGetSize(const unsigned char *src, size_t srcLen, UInt64 *unpackSize);
+
+/*
+Lzma2Compress
+-------------
+  Writes LZMA2 stream: a sequence of chunks of LZMA data (up to 2 MB of input
+  each). The chunks that LZMA can't compress are stored as uncompressed chunks,
+  so incompressible spans cost 3 bytes per 64 KB. The stream ends with the
+  end marker (0 byte), and it contains lc, lp and pb, so there is only one
+  property byte (the dictionary size).
+
+  level, dictSize, lc, lp, pb, fb, numThreads - the same as in LzmaCompress,
+    but (lc + lp) must be <= 4.
+  blockSize - 0 means solid stream. Else the dictionary and the state are
+    reset every blockSize bytes (blockSize >= 1 MB), so the dictionary is not
+    larger than blockSize. Each 2 MB span that looks incompressible
+    (LzmaIsIncompressible) is written as uncompressed chunks without encoding.
+
+  destLen must be at least LzmaCompressBound(srcLen) to avoid SZ_ERROR_OUTPUT_EOF.
+
+Out:
+  destLen  - processed output size
+  outProp  - LZMA2 property byte
+Returns:
+  SZ_OK               - OK
+  SZ_ERROR_MEM        - Memory allocation error
+  SZ_ERROR_PARAM      - Incorrect paramater
+  SZ_ERROR_OUTPUT_EOF - output buffer overflow
+  SZ_ERROR_THREAD     - errors in multithreading functions (only for Mt version)
+*/
+
+int WINAPI Lzma2Compress(unsigned char *dest, size_t *destLen, const unsigned char *src, size_t srcLen,
+  unsigned char *outProp, /* 1 byte */
+  int level, unsigned dictSize, int lc, int lp, int pb, int fb, int numThreads,
+  size_t blockSize /* 0 = solid */
+  );
+
+/*
+Lzma2Uncompress
+---------------
+  Decodes LZMA2 stream written by Lzma2Compress.
+  Parameters and return codes are the same as in LzmaUncompress, prop is the
+  property byte from Lzma2Compress. The decoding stops at the end marker.
+*/
+
+int WINAPI Lzma2Uncompress(unsigned char *dest, size_t *destLen, const unsigned char *src, SizeT *srcLen,
+  unsigned char prop);
+
 /*
 LzmaUncompress
 --------------
@@ -126,6 +622,177 @@ Returns:
 int WINAPI LzmaUncompress(unsigned char *dest, size_t *destLen, const unsigned char *src, SizeT *srcLen,
   const unsigned char *props, size_t propsSize);
 
+/* The same as LzmaUncompress, but the decoder tables are allocated from (alloc).
+   NULL means the default allocator. */
+
+int WINAPI LzmaUncompressEx(unsigned char *dest, size_t *destLen, const unsigned char *src, SizeT *srcLen,
+  const unsigned char *props, size_t propsSize, ISzAlloc *alloc);
+
+/*
+LzmaDecoderContext
+------------------
+  The context keeps the decoder state and its probability tables between
+  LzmaUncompressWithContext / LzmaUncompressToBufWithContext calls. The tables
+  are reallocated only if (lc + lp) of the stream is changed, so there is no
+  heap allocation for the streams with the same properties.
+  Don't use one context in several threads at the same time.
+
+LzmaDecoderContext_Create returns NULL in case of memory allocation error.
+*/
+
+typedef void * LzmaDecoderContext;
+
+LzmaDecoderContext WINAPI LzmaDecoderContext_Create(void);
+void WINAPI LzmaDecoderContext_Destroy(LzmaDecoderContext ctx);
+
+/*
+LzmaUncompressMemUsage
+----------------------
+  Returns the memory of the stream decoder (the probabilities and the
+  dictionary of dictSize bytes) for the props header, or 0 if props are
+  unsupported. The one call functions (LzmaUncompress*) decode to the output
+  buffer and allocate only the probabilities (4 KB + 1.5 KB << (lc + lp)).
+
+LzmaDecoderContext_SetMemLimit
+------------------------------
+  Sets the memory limit for the decoder tables of ctx (0 - no limit, default).
+  The calls with ctx return SZ_ERROR_MEM without any allocation, if the
+  stream requires more: the probabilities, and the temporary buffer in
+  LzmaUncompressWithDict. The output buffer of LzmaUncompressToBufWithContext
+  is controlled by outBuf->Resize.
+*/
+
+UInt64 WINAPI LzmaUncompressMemUsage(const unsigned char *props, size_t propsSize);
+void WINAPI LzmaDecoderContext_SetMemLimit(LzmaDecoderContext ctx, UInt64 memLimit);
+
+/*
+LzmaUncompressWithContext
+-------------------------
+  The same as LzmaUncompress, but it uses the decoder from ctx.
+  If ctx is NULL, it works as LzmaUncompress.
+*/
+
+int WINAPI LzmaUncompressWithContext(LzmaDecoderContext ctx,
+  unsigned char *dest, size_t *destLen, const unsigned char *src, SizeT *srcLen,
+  const unsigned char *props, size_t propsSize);
+
+/*
+LzmaUncompressWithDict
+----------------------
+  Decodes the data written by LzmaCompressWithDict, (dict, dictLen) must be
+  the same preset dictionary. The decoder uses a buffer of
+  (min(dictLen, dictSize) + *destLen) bytes. ctx keeps it for the next
+  calls and grows it only for a bigger message. ctx can be NULL.
+  Parameters and return codes are the same as in LzmaUncompress.
+*/
+
+int WINAPI LzmaUncompressWithDict(LzmaDecoderContext ctx,
+  unsigned char *dest, size_t *destLen, const unsigned char *src, SizeT *srcLen,
+  const unsigned char *dict, size_t dictLen, const unsigned char *props, size_t propsSize);
+
+/*
+LzmaUncompressWithModel
+-----------------------
+  Decodes the data written by LzmaCompressWithModel with the same loaded
+  model. ctx can be NULL. Parameters and return codes are the same as in
+  LzmaUncompress, and:
+    SZ_ERROR_DATA  - props are not of this model (the model ID or lc, lp, pb
+                     are different, or propsSize < LZMA_MODEL_PROPS_SIZE)
+    SZ_ERROR_PARAM - model is NULL
+*/
+
+int WINAPI LzmaUncompressWithModel(LzmaDecoderContext ctx,
+  unsigned char *dest, size_t *destLen, const unsigned char *src, SizeT *srcLen,
+  LzmaModel model, const unsigned char *props, size_t propsSize);
+
+/*
+LzmaUncompressToBuf
+-------------------
+  Decodes the stream in one pass into the buffer that grows on demand, so
+  the bytes that were already decoded are never decoded again. It can be
+  used when the unpacked size is unknown or not trusted.
+
+In:
+  outBuf   - output buffer callback. outBuf->Resize(outBuf, newSize) must
+             grow the buffer to newSize bytes keeping its contents and return
+             the new address of the buffer (or NULL in case of error).
+             The first call requests the initial buffer.
+  sizeHint - expected unpacked size (0 means unknown). If it's correct,
+             Resize is called only once.
+  src      - input data
+  srcLen   - input data size
+Out:
+  destLen  - unpacked size. The caller must use the address returned by the
+             last call of Resize. The buffer can be larger than destLen.
+  srcLen   - processed input size
+  status   - LZMA_STATUS_FINISHED_WITH_MARK
+               the stream was finished with end mark.
+             LZMA_STATUS_MAYBE_FINISHED_WITHOUT_MARK
+               all input was decoded and the stream has no end mark.
+             other values are possible only with error result.
+Returns:
+  SZ_OK                - OK
+  SZ_ERROR_DATA        - Data error
+  SZ_ERROR_MEM         - Memory allocation error or Resize error
+  SZ_ERROR_UNSUPPORTED - Unsupported properties
+  SZ_ERROR_INPUT_EOF   - the stream is truncated (status = LZMA_STATUS_NEEDS_MORE_INPUT)
+*/
+
+#ifndef __LZMA_STATUS_DEFINED
+#define __LZMA_STATUS_DEFINED
+
+typedef enum
+{
+  LZMA_STATUS_NOT_SPECIFIED,               /* use main error code instead */
+  LZMA_STATUS_FINISHED_WITH_MARK,          /* stream was finished with end mark. */
+  LZMA_STATUS_NOT_FINISHED,                /* stream was not finished */
+  LZMA_STATUS_NEEDS_MORE_INPUT,            /* you must provide more input bytes */
+  LZMA_STATUS_MAYBE_FINISHED_WITHOUT_MARK  /* there is probability that stream was finished without end mark */
+} ELzmaStatus;
+
+#endif
+
+typedef struct
+{
+  unsigned char *(*Resize)(void *p, size_t newSize);
+} ILzmaOutBuf;
+
+int WINAPI LzmaUncompressToBuf(ILzmaOutBuf *outBuf, size_t sizeHint, size_t *destLen,
+  const unsigned char *src, SizeT *srcLen, const unsigned char *props, size_t propsSize,
+  ELzmaStatus *status);
+
+/* The same as LzmaUncompressToBuf, but the decoder tables are allocated from (alloc).
+   NULL means the default allocator. */
+
+int WINAPI LzmaUncompressToBufEx(ILzmaOutBuf *outBuf, size_t sizeHint, size_t *destLen,
+  const unsigned char *src, SizeT *srcLen, const unsigned char *props, size_t propsSize,
+  ELzmaStatus *status, ISzAlloc *alloc);
+
+/* The same as LzmaUncompressToBuf, but it uses the decoder from ctx (can be NULL). */
+
+int WINAPI LzmaUncompressToBufWithContext(LzmaDecoderContext ctx,
+  ILzmaOutBuf *outBuf, size_t sizeHint, size_t *destLen,
+  const unsigned char *src, SizeT *srcLen, const unsigned char *props, size_t propsSize,
+  ELzmaStatus *status);
+
+/*
+LzmaUncompressStreamBegin / LzmaUncompressStreamCode
+----------------------------------------------------
+  Stream decoder for the input and the output in parts (see lzma::istreambuf
+  in lzma.hpp). ctx must not be NULL. LzmaUncompressStreamBegin allocates the
+  dictionary of dictSize bytes (it's checked with the memory limit of ctx and
+  kept in ctx for the next streams) and starts the stream.
+  LzmaUncompressStreamCode decodes from src to dest, as LzmaUncompress:
+  *destLen and *srcLen are the sizes of the buffers on input and the
+  processed sizes on output. Call it until status is
+  LZMA_STATUS_FINISHED_WITH_MARK, or until the known unpacked size is
+  decoded. The other calls with ctx break the stream (SZ_ERROR_PARAM then).
+*/
+
+int WINAPI LzmaUncompressStreamBegin(LzmaDecoderContext ctx, const unsigned char *props, size_t propsSize);
+int WINAPI LzmaUncompressStreamCode(LzmaDecoderContext ctx,
+  unsigned char *dest, size_t *destLen, const unsigned char *src, SizeT *srcLen, ELzmaStatus *status);
+
 #ifdef __cplusplus
 }
 #endif
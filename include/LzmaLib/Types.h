@@ -146,6 +146,10 @@ SRes SeqInStream_Read(ISeqInStream *stream, void *buf, size_t size);
 SRes SeqInStream_Read2(ISeqInStream *stream, void *buf, size_t size, SRes errorType);
 SRes SeqInStream_ReadByte(ISeqInStream *stream, Byte *buf);
 
+/* the push mode of the encoder (LzmaEnc_StreamCode, LzmaCompressStreamCode) reads
+   ISeqInStream only while it has more than LZMA_STREAM_LOOKAHEAD bytes of the caller */
+#define LZMA_STREAM_LOOKAHEAD (1 << 16)
+
 typedef struct
 {
   size_t (*Write)(void *p, const void *buf, size_t size);
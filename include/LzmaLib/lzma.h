@@ -7,6 +7,7 @@
 #ifndef __LZMA_H__
 #define __LZMA_H__
 
+#include <string.h>
 #include <LzmaLib/LzmaLib.h>
 
 struct LzmaPackedData
@@ -17,7 +18,27 @@ struct LzmaPackedData
     unsigned char *data;
 };
 
+//    : result->props[0] = LZMA_PROPS_STORED,
+// result->data -  source. lzmaUnpack*    .
+__inline
+int lzmaPackStored(const unsigned char *source, const size_t size,
+                   LzmaPackedData *result)
+{
+    unsigned char *buf = (unsigned char *)malloc(size ? size : 1);
+    if (!buf)
+        return 0;  // Error
+    memcpy(buf, source, size);
+    memset(result->props, 0, LZMA_PROPS_SIZE);
+    result->props[0] = LZMA_PROPS_STORED;
+    result->data = buf;
+    result->size = size;
+    result->realSize = size;
+    return 1;
+}
+
 // Params:
+// ctx             - LzmaEncoderContext_Create(),   
+//                    .   NULL.
 // source, size    - Uncompressed data.
 // result          -   .   
 //                        !
@@ -28,99 +49,147 @@ struct LzmaPackedData
 // result.props    -      
 //                   .    .  
 //                     .
+// ,  LZMA   ,   ,
+// . lzmaPackStored.
 // Return:
 // 1 - OK and 'result' filled.
 // 0 - Error.       result.data  
 //       .
 __inline
-int lzmaPack(const unsigned char *source, const size_t size,
-             LzmaPackedData *result)
+int lzmaPackWithContext(LzmaEncoderContext ctx, const unsigned char *source,
+                        const size_t size, LzmaPackedData *result)
 {
-    size_t bufsize = size * sizeof(unsigned char);
-    unsigned char *buf = (unsigned char *)malloc(bufsize);
+    //    ,    .
+    size_t bufsize = LzmaCompressBound(size);
+    unsigned char *buf;
     size_t propSize = LZMA_PROPS_SIZE;
-    while (1)
+    if (bufsize == 0)
+        return 0;  // Error
+    buf = (unsigned char *)malloc(bufsize);
+    if (!buf)
+        return 0;  // Error
+
+    if (LzmaCompressWithContext(ctx, buf, &bufsize, source, size,
+                                result->props, &propSize,
+                                9, 1 << 24, 3, 0, 2, 32, 2) == SZ_OK)
     {
-        int code = LzmaCompress(buf, &bufsize, source, size, result->props,
-                                &propSize, 9, 1 << 24, 3, 0, 2, 32, 2);
-        if (code == SZ_OK)
+        if (bufsize >= size)
+        {
+            free(buf);
+            return lzmaPackStored(source, size, result);
+        }
+        //      (), :
+        unsigned char *newbuf = (unsigned char *)realloc(buf, bufsize);
+        if (newbuf)
         {
-            //      (), :
-            unsigned char *newbuf = (unsigned char *)realloc(buf, bufsize);
-            if (!newbuf)
-                break;  // Error
             result->data = newbuf;
             result->size = bufsize;
             result->realSize = size;
             return 1;
         }
-        else if (code == SZ_ERROR_OUTPUT_EOF)
-        {
-            bufsize = bufsize + (bufsize >> 1);  // * 1.5
-            unsigned char *newbuf = (unsigned char *)realloc(buf, bufsize);
-            if (!newbuf)
-                break;  // Error
-            buf = newbuf;  // And try compress
-        }
-        else
-            break;  // Error
     }
 
     free(buf);
     return 0;
 }
 
+__inline
+int lzmaPack(const unsigned char *source, const size_t size,
+             LzmaPackedData *result)
+{
+    return lzmaPackWithContext(0, source, size, result);
+}
+
+struct LzmaUnpackBuf
+{
+    ILzmaOutBuf funcTable;  //   
+    unsigned char *data;
+};
+
+static unsigned char *lzmaUnpackResize(void *p, size_t newSize)
+{
+    LzmaUnpackBuf *buf = (LzmaUnpackBuf *)p;
+    unsigned char *newbuf = (unsigned char *)realloc(buf->data, newSize);
+    if (newbuf)
+        buf->data = newbuf;
+    return newbuf;
+}
+
 // Params:
+// ctx        - LzmaDecoderContext_Create(),   
+//               .   NULL.
 // source     - Compressed data.    lzmaCompress.
 // result,
 // resultSize -        
 //              .
 //                 *result  free().
+// status     - LZMA_STATUS_* ,   NULL.    
+//              (LZMA_PROPS_STORED) - LZMA_STATUS_NOT_SPECIFIED.
 // Return:
 // 1 - OK, 'result' and 'resultSize' filled.
 // 0 - Error.       result  
 //       .
 __inline
-int lzmaUnpack(const LzmaPackedData *source, unsigned char **result,
-               size_t *resultSize)
+int lzmaUnpackWithContext(LzmaDecoderContext ctx, const LzmaPackedData *source,
+                          unsigned char **result, size_t *resultSize,
+                          ELzmaStatus *status)
 {
-    const size_t DEST_SIZE = source->realSize * sizeof(unsigned char);
-    size_t bufsize = DEST_SIZE;
-    unsigned char *buf = (unsigned char *)malloc(bufsize);
+    //    ,     .
+    // realSize      .
+    LzmaUnpackBuf buf;
+    size_t bufsize;
     size_t sourceSize = source->size;
-    size_t propSize = LZMA_PROPS_SIZE;
-    while (1)
+    ELzmaStatus st;
+    int code;
+    if (source->props[0] == LZMA_PROPS_STORED)
     {
-        int code = LzmaUncompress(buf, &bufsize, source->data, &sourceSize,
-                                  source->props, LZMA_PROPS_SIZE);
-        if (code == SZ_OK)
+        unsigned char *newbuf;
+        if (status)
+            *status = LZMA_STATUS_NOT_SPECIFIED;
+        newbuf = (unsigned char *)malloc(source->size ? source->size : 1);
+        if (!newbuf)
+            return 0;  // Error
+        memcpy(newbuf, source->data, source->size);
+        *result = newbuf;
+        *resultSize = source->size;
+        return 1;
+    }
+    buf.funcTable.Resize = lzmaUnpackResize;
+    buf.data = 0;
+    code = LzmaUncompressToBufWithContext(ctx, &buf.funcTable,
+                                          source->realSize, &bufsize,
+                                          source->data, &sourceSize,
+                                          source->props, LZMA_PROPS_SIZE, &st);
+    if (status)
+        *status = st;
+    if (code == SZ_OK)
+    {
+        //      (), :
+        unsigned char *newbuf = (unsigned char *)realloc(buf.data, bufsize ? bufsize : 1);
+        if (newbuf)
         {
-            if (bufsize != DEST_SIZE)
-            {
-                unsigned char *newbuf = (unsigned char *)realloc(buf, bufsize);
-                if (!newbuf)
-                    break;  // Error
-                buf = newbuf;
-            }
-
-            *result = buf;
+            *result = newbuf;
             *resultSize = bufsize;
             return 1;
         }
-        else if (code == SZ_ERROR_OUTPUT_EOF)
-        {
-            bufsize = bufsize + 1024;  // + 1Kb
-            unsigned char *newbuf = (unsigned char *)realloc(buf, bufsize);
-            if (!newbuf)
-                break;  // Error
-            buf = newbuf;  // And try Uncompress
-        }
-        else
-            break;  // Error
     }
 
-    free(buf);
+    free(buf.data);
     return 0;
 }
 
+__inline
+int lzmaUnpackEx(const LzmaPackedData *source, unsigned char **result,
+                 size_t *resultSize, ELzmaStatus *status)
+{
+    return lzmaUnpackWithContext(0, source, result, resultSize, status);
+}
+
+__inline
+int lzmaUnpack(const LzmaPackedData *source, unsigned char **result,
+               size_t *resultSize)
+{
+    return lzmaUnpackEx(source, result, resultSize, 0);
+}
+
 #endif  // __LZMA_H__
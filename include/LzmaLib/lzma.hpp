@@ -9,8 +9,499 @@
 
 #include <LzmaLib/LzmaLib.h>
 
+#include <string.h>
+
+#include <streambuf>
+#include <vector>
+
+#if (defined(_MSVC_LANG) ? _MSVC_LANG : __cplusplus) >= 201703L && defined(__has_include)
+#if __has_include(<memory_resource>)
+#include <cstddef>
+#include <memory_resource>
+#define LZMA_HPP_PMR
+#endif
+#if __has_include(<string_view>)
+#include <iterator>
+#include <memory>
+#include <new>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#define LZMA_HPP_VIEW
+#endif
+#if (defined(_MSVC_LANG) ? _MSVC_LANG : __cplusplus) >= 202002L && __has_include(<span>)
+#include <span>
+#endif
+#endif
+
 namespace lzma {
 
+#ifdef LZMA_HPP_PMR
+
+// ISzAlloc that takes the memory from std::pmr::memory_resource, for example
+// from a per-thread std::pmr::unsynchronized_pool_resource: the encoder and
+// the decoder allocate only in the calling thread.
+// ISzAlloc::Free doesn't pass the size, so it is kept before the block.
+class MemoryResourceAlloc : public ISzAlloc
+{
+public:
+    explicit MemoryResourceAlloc(std::pmr::memory_resource &resource) : resource(resource)
+    {
+        Alloc = &MemoryResourceAlloc::allocate;
+        Free = &MemoryResourceAlloc::deallocate;
+    }
+
+    MemoryResourceAlloc(const MemoryResourceAlloc &) = delete;
+    MemoryResourceAlloc &operator=(const MemoryResourceAlloc &) = delete;
+
+private:
+    static const size_t kHeaderSize = alignof(std::max_align_t);
+
+    static void *allocate(void *p, size_t size)
+    {
+        MemoryResourceAlloc *self = static_cast<MemoryResourceAlloc *>(static_cast<ISzAlloc *>(p));
+        if (size == 0 || size > (size_t)-1 - kHeaderSize)
+            return 0;
+        try
+        {
+            char *block = static_cast<char *>(self->resource.allocate(size + kHeaderSize, kHeaderSize));
+            *reinterpret_cast<size_t *>(block) = size;
+            return block + kHeaderSize;
+        }
+        catch (...)
+        {
+            return 0;
+        }
+    }
+
+    static void deallocate(void *p, void *address)
+    {
+        MemoryResourceAlloc *self = static_cast<MemoryResourceAlloc *>(static_cast<ISzAlloc *>(p));
+        if (address == 0)
+            return;
+        char *block = static_cast<char *>(address) - kHeaderSize;
+        self->resource.deallocate(block, *reinterpret_cast<size_t *>(block) + kHeaderSize, kHeaderSize);
+    }
+
+    std::pmr::memory_resource &resource;
+};
+
+#endif
+
+// Keeps encoder buffers between pack() calls, see LzmaEncoderContext.
+class EncoderContext
+{
+public:
+    EncoderContext() : handle(LzmaEncoderContext_Create()) {}
+    ~EncoderContext() { LzmaEncoderContext_Destroy(handle); }
+
+    bool valid() const { return handle != 0; }
+    LzmaEncoderContext get() const { return handle; }
+
+    // 0 - no limit, see LzmaEncoderContext_SetMemLimit.
+    void setMemLimit(UInt64 memLimit) { LzmaEncoderContext_SetMemLimit(handle, memLimit); }
+
+private:
+    EncoderContext(const EncoderContext &);  // non-copyable
+    EncoderContext &operator=(const EncoderContext &);
+
+    LzmaEncoderContext handle;
+};
+
+// Keeps decoder tables between unpack() calls, see LzmaDecoderContext.
+class DecoderContext
+{
+public:
+    DecoderContext() : handle(LzmaDecoderContext_Create()) {}
+    ~DecoderContext() { LzmaDecoderContext_Destroy(handle); }
+
+    bool valid() const { return handle != 0; }
+    LzmaDecoderContext get() const { return handle; }
+
+    // 0 - no limit, see LzmaDecoderContext_SetMemLimit.
+    void setMemLimit(UInt64 memLimit) { LzmaDecoderContext_SetMemLimit(handle, memLimit); }
+
+private:
+    DecoderContext(const DecoderContext &);  // non-copyable
+    DecoderContext &operator=(const DecoderContext &);
+
+    LzmaDecoderContext handle;
+};
+
+#ifdef LZMA_HPP_VIEW
+
+// Allocator adapter that default-initializes the elements: resize() of
+// std::vector<unsigned char, lzma::DefaultInitAllocator<unsigned char> >
+// doesn't fill the new bytes with zeros before Encoder/Decoder overwrite them.
+template <typename T, typename TBase = std::allocator<T> >
+class DefaultInitAllocator : public TBase
+{
+    typedef std::allocator_traits<TBase> Traits;
+
+public:
+    template <typename U>
+    struct rebind
+    {
+        typedef DefaultInitAllocator<U, typename Traits::template rebind_alloc<U> > other;
+    };
+
+    using TBase::TBase;
+
+    template <typename U>
+    void construct(U *p) noexcept(std::is_nothrow_default_constructible<U>::value)
+    {
+        ::new (static_cast<void *>(p)) U;
+    }
+
+    template <typename U, typename... Args>
+    void construct(U *p, Args &&... args)
+    {
+        Traits::construct(static_cast<TBase &>(*this), p, std::forward<Args>(args)...);
+    }
+};
+
+namespace detail {
+
+template <typename TContainer>
+using Bytes = typename std::enable_if<sizeof(*std::data(std::declval<TContainer &>())) == 1>::type;
+
+template <typename TContainer>
+using Resizable = decltype(std::declval<TContainer &>().resize(size_t()), Bytes<TContainer>());
+
+// resize() without the exceptions. The new bytes are left uninitialized by
+// std::basic_string (C++23) and by the containers with DefaultInitAllocator.
+template <typename TContainer>
+bool resizeForOverwrite(TContainer &c, size_t size) noexcept
+{
+    try
+    {
+        c.resize(size);
+    }
+    catch (...)
+    {
+        return false;
+    }
+    return true;
+}
+
+#ifdef __cpp_lib_string_resize_and_overwrite
+template <typename TChar, typename TTraits, typename TAlloc>
+bool resizeForOverwrite(std::basic_string<TChar, TTraits, TAlloc> &s, size_t size) noexcept
+{
+    try
+    {
+        s.resize_and_overwrite(size, [](TChar *, size_t n) { return n; });
+    }
+    catch (...)
+    {
+        return false;
+    }
+    return true;
+}
+#endif
+
+}  // namespace detail
+
+// Input of Encoder/Decoder: any contiguous range of bytes (std::string_view,
+// std::span<const std::byte>, std::string, std::vector<unsigned char>, ...)
+// or (data, size). It doesn't own or copy the bytes.
+class InputView
+{
+public:
+    InputView() noexcept : p(0), n(0) {}
+    InputView(const void *data, size_t size) noexcept : p(static_cast<const unsigned char *>(data)), n(size) {}
+
+    template <typename TContainer, typename = detail::Bytes<const TContainer>,
+              typename = typename std::enable_if<!std::is_array<TContainer>::value>::type>
+    InputView(const TContainer &c) noexcept
+        : p(reinterpret_cast<const unsigned char *>(std::data(c))), n(std::size(c)) {}
+
+    const unsigned char *data() const noexcept { return p; }
+    size_t size() const noexcept { return n; }
+
+private:
+    const unsigned char *p;
+    size_t n;
+};
+
+// Caller-provided output of Encoder/Decoder: std::span<std::byte>, the
+// current bytes of a non-const container, or (data, size).
+class OutputView
+{
+public:
+    OutputView() noexcept : p(0), n(0) {}
+    OutputView(void *data, size_t size) noexcept : p(static_cast<unsigned char *>(data)), n(size) {}
+
+    template <typename TContainer, typename = detail::Bytes<TContainer>,
+              typename = typename std::enable_if<!std::is_same<typename std::decay<TContainer>::type, OutputView>::value &&
+                                                 !std::is_array<typename std::remove_reference<TContainer>::type>::value &&
+                                                 !std::is_const<typename std::remove_pointer<decltype(
+                                                     std::data(std::declval<TContainer &>()))>::type>::value>::type>
+    OutputView(TContainer &&c) noexcept
+        : p(reinterpret_cast<unsigned char *>(std::data(c))), n(std::size(c)) {}
+
+    unsigned char *data() const noexcept { return p; }
+    size_t size() const noexcept { return n; }
+
+private:
+    unsigned char *p;
+    size_t n;
+};
+
+// Move-only owner of LzmaEncoderContext with the compression parameters.
+// The calls return SZ_* codes (see LzmaCompress) and never throw. After a
+// failed creation (see valid()) or a move the calls return SZ_ERROR_MEM.
+// The output is compatible with PackedData: incompressible data is stored
+// as is, with props[0] == LZMA_PROPS_STORED.
+class Encoder
+{
+public:
+    explicit Encoder(int level = 5, unsigned dictSize = 0, int numThreads = 1) noexcept
+        : handle(LzmaEncoderContext_Create()), level(level), dictSize(dictSize), numThreads(numThreads) {}
+
+    Encoder(Encoder &&other) noexcept
+        : handle(other.handle), level(other.level), dictSize(other.dictSize), numThreads(other.numThreads)
+    {
+        other.handle = 0;
+    }
+
+    Encoder &operator=(Encoder &&other) noexcept
+    {
+        if (this != &other)
+        {
+            LzmaEncoderContext_Destroy(handle);
+            handle = other.handle;
+            level = other.level;
+            dictSize = other.dictSize;
+            numThreads = other.numThreads;
+            other.handle = 0;
+        }
+        return *this;
+    }
+
+    Encoder(const Encoder &) = delete;
+    Encoder &operator=(const Encoder &) = delete;
+
+    ~Encoder() { LzmaEncoderContext_Destroy(handle); }
+
+    bool valid() const noexcept { return handle != 0; }
+    LzmaEncoderContext get() const noexcept { return handle; }
+
+    // 0 - no limit, see LzmaEncoderContext_SetMemLimit.
+    void setMemLimit(UInt64 memLimit) noexcept { LzmaEncoderContext_SetMemLimit(handle, memLimit); }
+
+    // Compresses src to dest, packedSize is the written size. dest of src.size()
+    // bytes is always enough: the data is stored if it doesn't fit packed.
+    // SZ_ERROR_OUTPUT_EOF: dest is smaller and the packed data doesn't fit.
+    // The unpacked size is not written (as in LzmaCompress): keep src.size()
+    // with props, like PackedData::realSize, for Decoder::decode.
+    int encode(InputView src, OutputView dest, unsigned char (&props)[LZMA_PROPS_SIZE], size_t &packedSize) noexcept
+    {
+        packedSize = 0;
+        if (!handle)
+            return SZ_ERROR_MEM;
+        size_t destLen = dest.size() < src.size() ? dest.size() : src.size();
+        size_t propsSize = LZMA_PROPS_SIZE;
+        int code = SZ_ERROR_OUTPUT_EOF;
+        if (src.size() != 0)
+            code = LzmaCompressWithContext(handle, dest.data(), &destLen, src.data(), src.size(),
+                                           props, &propsSize, level, dictSize, -1, -1, -1, -1, numThreads);
+        if (code == SZ_OK && destLen < src.size())
+        {
+            packedSize = destLen;
+            return SZ_OK;
+        }
+        if ((code != SZ_OK && code != SZ_ERROR_OUTPUT_EOF) || dest.size() < src.size())
+            return code;
+        if (src.size() != 0)
+            memcpy(dest.data(), src.data(), src.size());
+        props[0] = LZMA_PROPS_STORED;
+        for (size_t i = 1; i < LZMA_PROPS_SIZE; i++)
+            props[i] = 0;
+        packedSize = src.size();
+        return SZ_OK;
+    }
+
+    // The same, dest (a contiguous container of bytes) is resized to the
+    // packed size without the value-initialization, if the container allows it.
+    template <typename TContainer, typename = detail::Resizable<TContainer> >
+    int encode(InputView src, TContainer &dest, unsigned char (&props)[LZMA_PROPS_SIZE]) noexcept
+    {
+        if (!detail::resizeForOverwrite(dest, src.size()))
+            return SZ_ERROR_MEM;
+        size_t packedSize;
+        int code = encode(src, OutputView(std::data(dest), std::size(dest)), props, packedSize);
+        detail::resizeForOverwrite(dest, packedSize);
+        return code;
+    }
+
+private:
+    LzmaEncoderContext handle;
+    int level;
+    unsigned dictSize;
+    int numThreads;
+};
+
+// Move-only owner of LzmaDecoderContext for the data of Encoder (and
+// LzmaCompress). The calls return SZ_* codes (see LzmaUncompress) and never
+// throw. After a failed creation or a move the calls return SZ_ERROR_MEM.
+class Decoder
+{
+public:
+    Decoder() noexcept : handle(LzmaDecoderContext_Create()) {}
+
+    Decoder(Decoder &&other) noexcept : handle(other.handle) { other.handle = 0; }
+
+    Decoder &operator=(Decoder &&other) noexcept
+    {
+        if (this != &other)
+        {
+            LzmaDecoderContext_Destroy(handle);
+            handle = other.handle;
+            other.handle = 0;
+        }
+        return *this;
+    }
+
+    Decoder(const Decoder &) = delete;
+    Decoder &operator=(const Decoder &) = delete;
+
+    ~Decoder() { LzmaDecoderContext_Destroy(handle); }
+
+    bool valid() const noexcept { return handle != 0; }
+    LzmaDecoderContext get() const noexcept { return handle; }
+
+    // 0 - no limit, see LzmaDecoderContext_SetMemLimit.
+    void setMemLimit(UInt64 memLimit) noexcept { LzmaDecoderContext_SetMemLimit(handle, memLimit); }
+
+    // Decompresses src to dest of the unpacked size, unpackedSize is the
+    // written size. SZ_ERROR_OUTPUT_EOF: the data doesn't fit dest.
+    int decode(InputView src, const unsigned char (&props)[LZMA_PROPS_SIZE], OutputView dest, size_t &unpackedSize) noexcept
+    {
+        unpackedSize = 0;
+        if (!handle)
+            return SZ_ERROR_MEM;
+        if (props[0] == LZMA_PROPS_STORED)
+        {
+            if (src.size() > dest.size())
+                return SZ_ERROR_OUTPUT_EOF;
+            if (src.size() != 0)
+                memcpy(dest.data(), src.data(), src.size());
+            unpackedSize = src.size();
+            return SZ_OK;
+        }
+        size_t destLen = 0;
+        SizeT srcLen = src.size();
+        int code;
+        if (dest.size() == 0)
+        {
+            // Only the empty stream fits: the decoder reads the range coder
+            // header and stops, the data of any other stream remains.
+            code = LzmaUncompressWithContext(handle, dest.data(), &destLen, src.data(), &srcLen, props, LZMA_PROPS_SIZE);
+            if (code == SZ_OK && srcLen != src.size())
+                code = SZ_ERROR_OUTPUT_EOF;
+            return code;
+        }
+        // The buffer of LzmaUncompressToBufWithContext can't grow beyond dest,
+        // so a stream that isn't finished in dest fails on the resize.
+        FixedBuf buf;
+        buf.funcTable.Resize = &FixedBuf::resize;
+        buf.data = dest.data();
+        buf.size = dest.size();
+        buf.overflow = false;
+        ELzmaStatus status;
+        code = LzmaUncompressToBufWithContext(handle, &buf.funcTable, dest.size(), &destLen,
+                                              src.data(), &srcLen, props, LZMA_PROPS_SIZE, &status);
+        if (buf.overflow || (code == SZ_OK && (srcLen != src.size() ||
+                (status != LZMA_STATUS_FINISHED_WITH_MARK && status != LZMA_STATUS_MAYBE_FINISHED_WITHOUT_MARK))))
+            return SZ_ERROR_OUTPUT_EOF;
+        if (code == SZ_OK)
+            unpackedSize = destLen;
+        return code;
+    }
+
+    // The same, dest (a contiguous container of bytes) grows on demand from
+    // sizeHint and is resized to the unpacked size; the data is decoded once
+    // and the new bytes are not value-initialized, if the container allows it.
+    // dest is cleared on errors. Stored data: *status is LZMA_STATUS_NOT_SPECIFIED.
+    template <typename TContainer, typename = detail::Resizable<TContainer> >
+    int decode(InputView src, const unsigned char (&props)[LZMA_PROPS_SIZE], TContainer &dest,
+               ELzmaStatus *status = 0, size_t sizeHint = 0) noexcept
+    {
+        if (status)
+            *status = LZMA_STATUS_NOT_SPECIFIED;
+        if (!handle)
+        {
+            dest.clear();
+            return SZ_ERROR_MEM;
+        }
+        if (props[0] == LZMA_PROPS_STORED)
+        {
+            if (!detail::resizeForOverwrite(dest, src.size()))
+                return SZ_ERROR_MEM;
+            if (src.size() != 0)
+                memcpy(std::data(dest), src.data(), src.size());
+            return SZ_OK;
+        }
+
+        OutBuf<TContainer> buf;
+        buf.funcTable.Resize = &OutBuf<TContainer>::resize;
+        buf.result = &dest;
+        size_t destLen = 0;
+        SizeT srcLen = src.size();
+        ELzmaStatus st;
+        int code = LzmaUncompressToBufWithContext(handle, &buf.funcTable, sizeHint, &destLen,
+                                                  src.data(), &srcLen, props, LZMA_PROPS_SIZE, &st);
+        if (status)
+            *status = st;
+        if (code == SZ_OK)
+            detail::resizeForOverwrite(dest, destLen);
+        else
+            dest.clear();
+        return code;
+    }
+
+private:
+    struct FixedBuf
+    {
+        ILzmaOutBuf funcTable;  // must be first
+        unsigned char *data;
+        size_t size;
+        bool overflow;
+
+        static unsigned char *resize(void *p, size_t newSize)
+        {
+            FixedBuf *buf = static_cast<FixedBuf *>(p);
+            if (newSize > buf->size)
+            {
+                buf->overflow = true;
+                return 0;
+            }
+            return buf->data;
+        }
+    };
+
+    template <typename TContainer>
+    struct OutBuf
+    {
+        ILzmaOutBuf funcTable;  // must be first
+        TContainer *result;
+
+        static unsigned char *resize(void *p, size_t newSize)
+        {
+            OutBuf *buf = static_cast<OutBuf *>(p);
+            if (!detail::resizeForOverwrite(*buf->result, newSize))
+                return 0;
+            return reinterpret_cast<unsigned char *>(std::data(*buf->result));
+        }
+    };
+
+    LzmaDecoderContext handle;
+};
+
+#endif
+
 template <typename TBuffer>
 struct PackedData
 {
@@ -18,16 +509,111 @@ struct PackedData
     size_t realSize;
     TBuffer data;
 
-    bool pack(const TBuffer source)
+    bool pack(const TBuffer &source)
+    {
+        return pack(source, 0);
+    }
+
+    bool pack(const TBuffer &source, EncoderContext &ctx)
+    {
+        return ctx.valid() && pack(source, ctx.get());
+    }
+
+    // Data that LZMA can't shrink is stored as is, with
+    // props[0] == LZMA_PROPS_STORED.
+    bool pack(const TBuffer &source, LzmaEncoderContext ctx)
+    {
+        return encode(source, ctx, 0, 0);
+    }
+
+#ifdef LZMA_HPP_VIEW
+    // Any contiguous bytes (see InputView) with the parameters of (encoder).
+    bool pack(InputView source, Encoder &encoder)
+    {
+        if (encoder.encode(source, data, props) != SZ_OK)
+        {
+            data.clear();
+            return false;
+        }
+        realSize = source.size();
+        return true;
+    }
+#endif
+
+#ifdef LZMA_HPP_PMR
+    // All memory of the encoder is taken from (resource).
+    bool pack(const TBuffer &source, std::pmr::memory_resource &resource)
+    {
+        MemoryResourceAlloc alloc(resource);
+        return encode(source, 0, &alloc, &alloc);
+    }
+
+    bool pack(const TBuffer &source, std::pmr::memory_resource &resource, std::pmr::memory_resource &bigResource)
+    {
+        MemoryResourceAlloc alloc(resource), allocBig(bigResource);
+        return encode(source, 0, &alloc, &allocBig);
+    }
+#endif
+
+    // One pass: 'result' grows on demand and decoded bytes are never decoded
+    // again. realSize is only used as the initial size of 'result'.
+    // Stored data is copied, *status is LZMA_STATUS_NOT_SPECIFIED then.
+    bool unpack(TBuffer &result, ELzmaStatus *status = 0)
+    {
+        return unpack(result, LzmaDecoderContext(0), status);
+    }
+
+    bool unpack(TBuffer &result, DecoderContext &ctx, ELzmaStatus *status = 0)
     {
-        size_t packedSize = source.size();
-        data.resize(packedSize);
+        if (!ctx.valid())
+        {
+            result.clear();
+            return false;
+        }
+        return unpack(result, ctx.get(), status);
+    }
+
+    bool unpack(TBuffer &result, LzmaDecoderContext ctx, ELzmaStatus *status)
+    {
+        return decode(result, ctx, 0, status);
+    }
+
+#ifdef LZMA_HPP_VIEW
+    bool unpack(TBuffer &result, Decoder &decoder, ELzmaStatus *status = 0)
+    {
+        return decoder.decode(data, props, result, status, realSize) == SZ_OK;
+    }
+#endif
+
+#ifdef LZMA_HPP_PMR
+    // The decoder tables are taken from (resource).
+    bool unpack(TBuffer &result, std::pmr::memory_resource &resource, ELzmaStatus *status = 0)
+    {
+        MemoryResourceAlloc alloc(resource);
+        return decode(result, 0, &alloc, status);
+    }
+#endif
+
+private:
+    // alloc != 0: LzmaCompressEx with (alloc, allocBig), else the encoder from ctx (can be 0).
+    bool encode(const TBuffer &source, LzmaEncoderContext ctx, ISzAlloc *alloc, ISzAlloc *allocBig)
+    {
+        // Allocate the worst case once, so the input is encoded only once.
+        size_t packedSize = LzmaCompressBound(source.size());
         size_t propSize = LZMA_PROPS_SIZE;
-        while (1)
+        if (packedSize != 0)
         {
-            int code = LzmaCompress((unsigned char *)&data[0], &packedSize,
-                                    (unsigned char *)&source[0], source.size(),
-                                    props, &propSize, 9, 1 << 24, 3, 0, 2, 32, 2);
+            data.resize(packedSize);
+            int code = alloc
+                ? LzmaCompressEx((unsigned char *)&data[0], &packedSize,
+                                 (unsigned char *)&source[0], source.size(),
+                                 props, &propSize, 9, 1 << 24, 3, 0, 2, 32, 2, alloc, allocBig)
+                : LzmaCompressWithContext(ctx,
+                                 (unsigned char *)&data[0], &packedSize,
+                                 (unsigned char *)&source[0], source.size(),
+                                 props, &propSize, 9, 1 << 24, 3, 0, 2, 32, 2);
+            if (code == SZ_OK && packedSize >= source.size())
+                return store(source);
             if (code == SZ_OK)
             {
                 data.resize(packedSize);
@@ -35,13 +621,6 @@ struct PackedData
                 realSize = source.size();
                 return true;
             }
-            else if (code == SZ_ERROR_OUTPUT_EOF)
-            {
-                packedSize = packedSize + (packedSize >> 1);  // * 1.5
-                data.resize(packedSize);
-            }
-            else
-                break;  // Error
         }
 
         data.clear();
@@ -49,39 +628,74 @@ struct PackedData
         return false;
     }
 
-    bool unpack(TBuffer &result)
+    // alloc != 0: the decoder tables are allocated from alloc, else the decoder from ctx (can be 0).
+    bool decode(TBuffer &result, LzmaDecoderContext ctx, ISzAlloc *alloc, ELzmaStatus *status)
     {
-        size_t resultSize = realSize;
-        result.resize(resultSize);
+        if (props[0] == LZMA_PROPS_STORED)
+        {
+            if (status)
+                *status = LZMA_STATUS_NOT_SPECIFIED;
+            result = data;
+            return true;
+        }
+
+        OutBuf buf;
+        buf.funcTable.Resize = &OutBuf::resize;
+        buf.result = &result;
+        size_t resultSize = 0;
         size_t packedSize = data.size();
-        size_t propSize = LZMA_PROPS_SIZE;
-        while (1)
+        ELzmaStatus st;
+        int code = alloc
+            ? LzmaUncompressToBufEx(&buf.funcTable, realSize, &resultSize,
+                                    (unsigned char*)&data[0], &packedSize,
+                                    props, LZMA_PROPS_SIZE, &st, alloc)
+            : LzmaUncompressToBufWithContext(ctx,
+                                    &buf.funcTable, realSize, &resultSize,
+                                    (unsigned char*)&data[0], &packedSize,
+                                    props, LZMA_PROPS_SIZE, &st);
+        if (status)
+            *status = st;
+        if (code == SZ_OK)
         {
-            int code = LzmaUncompress((unsigned char*)&result[0], &resultSize,
-                                      (unsigned char*)&data[0], &packedSize,
-                                      props, LZMA_PROPS_SIZE);
-            if (code == SZ_OK)
-            {
-                if (resultSize != realSize)
-                {
-                    result.resize(resultSize);
-                    // data.shrink_to_fit();
-                }
-                return true;
-            }
-            else if (code == SZ_ERROR_OUTPUT_EOF)
-            {
-                resultSize = resultSize + 1024;  // + 1Kb
-                result.resize(resultSize);
-            }
-            else
-                break;  // Error
+            result.resize(resultSize);
+            // result.shrink_to_fit();
+            return true;
         }
 
         result.clear();
         // result.shrink_to_fit();
         return false;
     }
+
+    bool store(const TBuffer &source)
+    {
+        data = source;
+        props[0] = LZMA_PROPS_STORED;
+        for (size_t i = 1; i < LZMA_PROPS_SIZE; i++)
+            props[i] = 0;
+        realSize = source.size();
+        return true;
+    }
+
+    struct OutBuf
+    {
+        ILzmaOutBuf funcTable;  // must be first
+        TBuffer *result;
+
+        static unsigned char *resize(void *p, size_t newSize)
+        {
+            OutBuf *buf = static_cast<OutBuf *>(p);
+            try
+            {
+                buf->result->resize(newSize);
+            }
+            catch (...)
+            {
+                return 0;
+            }
+            return (unsigned char *)&(*buf->result)[0];
+        }
+    };
 };
 
 template<typename TInStream, typename TContainer>
@@ -135,6 +749,233 @@ static bool writePackedData(TOutStream &s, lzma::PackedData<TContainer> &pd)
     return true;
 }
 
+// Compressing output buffer: the data written to it is compressed to (dest)
+// in the .lzma format: props, unpacked size (8 bytes, all 0xFF - unknown) and
+// the stream with the end mark. Memory doesn't depend on the size of the data:
+// the encoder copies the put area (kBufferSize bytes) to its window part by part.
+//
+//     lzma::ostreambuf buf(file.rdbuf());
+//     std::ostream out(&buf);
+//     out << ...;
+//     bool ok = buf.close() && out;  // or the destructor
+class ostreambuf : public std::streambuf
+{
+public:
+    enum { kBufferSize = 1 << 20, kHeaderSize = LZMA_PROPS_SIZE + 8 };
+
+    explicit ostreambuf(std::streambuf *dest, int level = 5, unsigned dictSize = 0)
+        : dest(dest), buffer(kBufferSize), readPos(0), readSize(0), failed(false), closed(false)
+    {
+        inStream.funcTable.Read = &ostreambuf::read;
+        inStream.self = this;
+        outStream.funcTable.Write = &ostreambuf::write;
+        outStream.self = this;
+        setp(&buffer[0], &buffer[0] + buffer.size());
+
+        unsigned char header[kHeaderSize];
+        size_t propsSize = LZMA_PROPS_SIZE;
+        failed = !ctx.valid() || LzmaCompressStreamBegin(ctx.get(), &outStream.funcTable, &inStream.funcTable,
+                                                         header, &propsSize, level, dictSize, -1, -1, -1, -1) != SZ_OK;
+        if (!failed)
+        {
+            memset(header + LZMA_PROPS_SIZE, 0xFF, 8);
+            failed = dest->sputn(reinterpret_cast<const char *>(header), kHeaderSize) != kHeaderSize;
+        }
+    }
+
+    ~ostreambuf() { close(); }
+
+    // Encodes the rest of the data and writes the end of the stream.
+    // Returns false if there was an error. The buffer can't be written after it.
+    bool close()
+    {
+        if (!closed)
+        {
+            closed = true;
+            code(true);
+            setp(0, 0);
+        }
+        return !failed;
+    }
+
+protected:
+    int_type overflow(int_type c)
+    {
+        if (closed)
+            return traits_type::eof();
+        code(false);
+        if (failed)
+            return traits_type::eof();
+        if (!traits_type::eq_int_type(c, traits_type::eof()))
+        {
+            *pptr() = traits_type::to_char_type(c);
+            pbump(1);
+        }
+        return traits_type::not_eof(c);
+    }
+
+    // The end of the stream is written only by close().
+    int sync()
+    {
+        return failed ? -1 : 0;
+    }
+
+private:
+    // Encodes the put area up to the last LZMA_STREAM_LOOKAHEAD bytes (all with finish)
+    // and moves the rest to the beginning of the buffer.
+    void code(bool finish)
+    {
+        if (failed)
+            return;
+        UInt64 inSize = readSize + (pptr() - &buffer[readPos]);
+        failed = LzmaCompressStreamCode(ctx.get(), inSize, finish ? 1 : 0) != SZ_OK;
+        size_t rest = pptr() - &buffer[readPos];
+        memmove(&buffer[0], &buffer[readPos], rest);
+        readPos = 0;
+        setp(&buffer[0], &buffer[0] + buffer.size());
+        pbump((int)rest);
+    }
+
+    // The match finder needs the history in its window, so the data is copied there.
+    static SRes read(void *p, void *buf, size_t *size)
+    {
+        ostreambuf *self = static_cast<InStream *>(p)->self;
+        size_t rest = self->pptr() - &self->buffer[self->readPos];
+        if (*size > rest)
+            *size = rest;
+        memcpy(buf, &self->buffer[self->readPos], *size);
+        self->readPos += *size;
+        self->readSize += *size;
+        return SZ_OK;
+    }
+
+    static size_t write(void *p, const void *buf, size_t size)
+    {
+        ostreambuf *self = static_cast<OutStream *>(p)->self;
+        return (size_t)self->dest->sputn(static_cast<const char *>(buf), (std::streamsize)size);
+    }
+
+    struct InStream
+    {
+        ISeqInStream funcTable;  // must be first
+        ostreambuf *self;
+    };
+
+    struct OutStream
+    {
+        ISeqOutStream funcTable;  // must be first
+        ostreambuf *self;
+    };
+
+    ostreambuf(const ostreambuf &);  // non-copyable
+    ostreambuf &operator=(const ostreambuf &);
+
+    std::streambuf *dest;
+    EncoderContext ctx;
+    std::vector<char> buffer;
+    size_t readPos;   // the encoder has read the put area up to readPos
+    UInt64 readSize;  // total size read by the encoder
+    InStream inStream;
+    OutStream outStream;
+    bool failed;
+    bool closed;
+};
+
+// Decompressing input buffer for the .lzma data from (src) (see ostreambuf).
+// The stream must have the end mark, if the unpacked size is unknown in the header.
+// Memory: the dictionary of the stream (dictSize bytes, memLimit is checked
+// before the allocation, 0 - no limit) and two buffers of kBufferSize bytes.
+// (src) is read in blocks, so the bytes after the stream can be read from it too.
+class istreambuf : public std::streambuf
+{
+public:
+    enum { kBufferSize = 1 << 16, kHeaderSize = LZMA_PROPS_SIZE + 8 };
+
+    explicit istreambuf(std::streambuf *src, UInt64 memLimit = 0)
+        : src(src), in(kBufferSize), out(kBufferSize), inPos(0), inSize(0), rem(0),
+          started(false), srcEnd(false), finished(false), failed(false)
+    {
+        ctx.setMemLimit(memLimit);
+    }
+
+    // true if the data or the header is incorrect, the stream is truncated,
+    // or the dictionary is over memLimit.
+    bool error() const { return failed; }
+
+protected:
+    int_type underflow()
+    {
+        if (gptr() < egptr())
+            return traits_type::to_int_type(*gptr());
+        if (!started && !start())
+            failed = true;
+        while (!finished && !failed)
+        {
+            if (inPos == inSize && !srcEnd)
+            {
+                inSize = (size_t)src->sgetn(&in[0], (std::streamsize)in.size());
+                inPos = 0;
+                srcEnd = (inSize == 0);
+            }
+            size_t outSize = out.size();
+            if (rem < outSize)
+                outSize = (size_t)rem;
+            SizeT inProcessed = inSize - inPos;
+            ELzmaStatus status;
+            if (LzmaUncompressStreamCode(ctx.get(), reinterpret_cast<unsigned char *>(&out[0]), &outSize,
+                                         reinterpret_cast<unsigned char *>(&in[0]) + inPos, &inProcessed, &status) != SZ_OK)
+            {
+                failed = true;
+                break;
+            }
+            inPos += inProcessed;
+            if (rem != kUnknownSize)
+                rem -= outSize;
+            finished = (status == LZMA_STATUS_FINISHED_WITH_MARK || rem == 0);
+            if (outSize != 0)
+            {
+                setg(&out[0], &out[0], &out[0] + outSize);
+                return traits_type::to_int_type(out[0]);
+            }
+            if (inProcessed == 0 && srcEnd)
+                failed = true;  // truncated
+        }
+        return traits_type::eof();
+    }
+
+private:
+    static const UInt64 kUnknownSize = ~(UInt64)0;
+
+    bool start()
+    {
+        unsigned char header[kHeaderSize];
+        started = true;
+        if (src->sgetn(reinterpret_cast<char *>(header), kHeaderSize) != kHeaderSize ||
+            !ctx.valid() || LzmaUncompressStreamBegin(ctx.get(), header, LZMA_PROPS_SIZE) != SZ_OK)
+            return false;
+        rem = 0;
+        for (int i = kHeaderSize - 1; i >= LZMA_PROPS_SIZE; i--)
+            rem = (rem << 8) | header[i];
+        finished = (rem == 0);
+        return true;
+    }
+
+    istreambuf(const istreambuf &);  // non-copyable
+    istreambuf &operator=(const istreambuf &);
+
+    std::streambuf *src;
+    DecoderContext ctx;
+    std::vector<char> in;
+    std::vector<char> out;
+    size_t inPos;
+    size_t inSize;
+    UInt64 rem;  // unpacked size that is not decoded yet, kUnknownSize - unknown
+    bool started;
+    bool srcEnd;
+    bool finished;
+    bool failed;
+};
+
 }  // namespace lzma
 
 #endif  // __LZMA_H__
@@ -5,6 +5,14 @@ Public domain */
 
 #ifdef _WIN32
 #include <windows.h>
+#else
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
 #endif
 #include <stdlib.h>
 
@@ -44,8 +52,42 @@ void MyFree(void *address)
   free(address);
 }
 
+/* each block of BigAlloc starts with the header, the data follows it with the alignment
+   that is not smaller than the alignment of malloc */
+
+typedef struct
+{
+  size_t mapSize; /* POSIX: the size of the mapping, 0 for the block from malloc */
+  size_t pageSize;
+  int pages;
+} CBlockHeader;
+
+#define kBlockHeaderSize 64
+
+static void *SetBlockPages(void *address, int pages, size_t pageSize)
+{
+  CBlockHeader *h = (CBlockHeader *)((char *)address - kBlockHeaderSize);
+  h->pages = pages;
+  h->pageSize = pageSize;
+  return address;
+}
+
+int BigAlloc_GetPages(const void *address, size_t *pageSize)
+{
+  const CBlockHeader *h = (const CBlockHeader *)((const char *)address - kBlockHeaderSize);
+  *pageSize = h->pageSize;
+  return h->pages;
+}
+
 #ifdef _WIN32
 
+static size_t GetNormalPageSize()
+{
+  SYSTEM_INFO si;
+  GetSystemInfo(&si);
+  return si.dwPageSize;
+}
+
 void *MidAlloc(size_t size)
 {
   if (size == 0)
@@ -94,22 +136,27 @@ void SetLargePageSize()
 
 void *BigAlloc(size_t size)
 {
-  if (size == 0)
+  char *res;
+  if (size == 0 || size > (size_t)0 - kBlockHeaderSize - (1 << 30))
     return 0;
   #ifdef _SZ_ALLOC_DEBUG
   fprintf(stderr, "\nAlloc_Big %10d bytes;  count = %10d", size, g_allocCountBig++);
   #endif
+  size += kBlockHeaderSize;
   
   #ifdef _7ZIP_LARGE_PAGES
   if (g_LargePageSize != 0 && g_LargePageSize <= (1 << 30) && size >= (1 << 18))
   {
-    void *res = VirtualAlloc(0, (size + g_LargePageSize - 1) & (~(g_LargePageSize - 1)),
+    res = (char *)VirtualAlloc(0, (size + g_LargePageSize - 1) & (~(g_LargePageSize - 1)),
         MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
     if (res != 0)
-      return res;
+      return SetBlockPages(res + kBlockHeaderSize, BIG_ALLOC_PAGES_LARGE, g_LargePageSize);
   }
   #endif
-  return VirtualAlloc(0, size, MEM_COMMIT, PAGE_READWRITE);
+  res = (char *)VirtualAlloc(0, size, MEM_COMMIT, PAGE_READWRITE);
+  if (res == 0)
+    return 0;
+  return SetBlockPages(res + kBlockHeaderSize, BIG_ALLOC_PAGES_NORMAL, GetNormalPageSize());
 }
 
 void BigFree(void *address)
@@ -121,7 +168,287 @@ void BigFree(void *address)
   
   if (address == 0)
     return;
-  VirtualFree(address, 0, MEM_RELEASE);
+  VirtualFree((char *)address - kBlockHeaderSize, 0, MEM_RELEASE);
+}
+
+int BigAlloc_SetLargePages(int enable)
+{
+  #ifdef _7ZIP_LARGE_PAGES
+  if (enable)
+    SetLargePageSize();
+  else
+    g_LargePageSize = 0;
+  return g_LargePageSize != 0;
+  #else
+  enable = enable;
+  return 0;
+  #endif
+}
+
+/* The address range is reserved to find a free place for both views, and then
+   released: other thread can take it before MapViewOfFileEx, so it's repeated. */
+
+#define kRingNumAttempts 8
+
+void *RingAlloc(size_t size, size_t *ringSize)
+{
+  SYSTEM_INFO si;
+  size_t ring;
+  HANDLE mapping;
+  int i;
+  GetSystemInfo(&si);
+  ring = (size + si.dwAllocationGranularity - 1) & ~((size_t)si.dwAllocationGranularity - 1);
+  if (size == 0 || ring < size || ring > ((size_t)0 - 1) / 2)
+    return 0;
+  mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+      (DWORD)((ring >> 16) >> 16), (DWORD)ring, NULL);
+  if (mapping == NULL)
+    return 0;
+  for (i = 0; i < kRingNumAttempts; i++)
+  {
+    char *p = (char *)VirtualAlloc(0, ring * 2, MEM_RESERVE, PAGE_NOACCESS);
+    if (p == 0)
+      break;
+    VirtualFree(p, 0, MEM_RELEASE);
+    if (MapViewOfFileEx(mapping, FILE_MAP_WRITE, 0, 0, ring, p) != p)
+      continue;
+    if (MapViewOfFileEx(mapping, FILE_MAP_WRITE, 0, 0, ring, p + ring) != p + ring)
+    {
+      UnmapViewOfFile(p);
+      continue;
+    }
+    CloseHandle(mapping);
+    *ringSize = ring;
+    return p;
+  }
+  CloseHandle(mapping);
+  return 0;
+}
+
+void RingFree(void *address, size_t ringSize)
+{
+  if (address == 0)
+    return;
+  UnmapViewOfFile((char *)address + ringSize);
+  UnmapViewOfFile(address);
+}
+
+#else
+
+/* MidAlloc and BigAlloc blocks start with CBlockHeader that stores the size of the mapping */
+#define kLargeBlockMin ((size_t)1 << 18)
+
+static size_t g_LargePageSize = 0;
+static int g_TransparentPages = 0;
+
+static size_t GetNormalPageSize()
+{
+  long size = sysconf(_SC_PAGESIZE);
+  return (size > 0) ? (size_t)size : 4096;
+}
+
+static void *MapBlock(size_t size, size_t pageSize, int flags)
+{
+  size_t mapSize;
+  void *p;
+  if (size > (size_t)0 - kBlockHeaderSize - pageSize)
+    return 0;
+  mapSize = (size + kBlockHeaderSize + pageSize - 1) & ~(pageSize - 1);
+  p = mmap(0, mapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+  if (p == MAP_FAILED)
+    return 0;
+  ((CBlockHeader *)p)->mapSize = mapSize;
+  return (char *)p + kBlockHeaderSize;
+}
+
+static void UnmapBlock(void *address)
+{
+  CBlockHeader *h = (CBlockHeader *)((char *)address - kBlockHeaderSize);
+  if (h->mapSize == 0)
+    MyFree(h);
+  else
+    munmap(h, h->mapSize);
+}
+
+#ifdef MADV_HUGEPAGE
+
+/* the kernel can use huge pages only for aligned ranges of the mapping,
+   so the mapping is aligned for the huge page size */
+
+static void *MapBlockTransparent(size_t size)
+{
+  size_t pageSize = g_LargePageSize, mapSize, head;
+  char *p, *aligned;
+  if (size > (size_t)0 - kBlockHeaderSize - pageSize * 2)
+    return 0;
+  mapSize = (size + kBlockHeaderSize + pageSize - 1) & ~(pageSize - 1);
+  p = (char *)mmap(0, mapSize + pageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if ((void *)p == MAP_FAILED)
+    return 0;
+  aligned = p + ((pageSize - ((size_t)p & (pageSize - 1))) & (pageSize - 1));
+  head = aligned - p;
+  if (head != 0)
+    munmap(p, head);
+  if (head != pageSize)
+    munmap(aligned + mapSize, pageSize - head);
+  if (madvise(aligned, mapSize, MADV_HUGEPAGE) != 0)
+  {
+    munmap(aligned, mapSize);
+    return 0;
+  }
+  ((CBlockHeader *)aligned)->mapSize = mapSize;
+  return aligned + kBlockHeaderSize;
+}
+
+#endif
+
+void SetLargePageSize()
+{
+  char line[256];
+  size_t size = 0;
+  FILE *f = fopen("/proc/meminfo", "r");
+  if (f == 0)
+    return;
+  while (fgets(line, sizeof(line), f))
+    if (strncmp(line, "Hugepagesize:", 13) == 0)
+    {
+      size = (size_t)strtoul(line + 13, 0, 10) << 10;
+      break;
+    }
+  fclose(f);
+  if (size == 0 || (size & (size - 1)) != 0 || size > ((size_t)1 << 30))
+    return;
+  g_LargePageSize = size;
+
+  g_TransparentPages = 0;
+  f = fopen("/sys/kernel/mm/transparent_hugepage/enabled", "r");
+  if (f != 0)
+  {
+    if (fgets(line, sizeof(line), f) && strstr(line, "[never]") == 0)
+      g_TransparentPages = 1;
+    fclose(f);
+  }
+}
+
+int BigAlloc_SetLargePages(int enable)
+{
+  if (enable)
+    SetLargePageSize();
+  else
+    g_LargePageSize = 0;
+  return g_LargePageSize != 0;
+}
+
+void *MidAlloc(size_t size)
+{
+  if (size == 0)
+    return 0;
+  #ifdef _SZ_ALLOC_DEBUG
+  fprintf(stderr, "\nAlloc_Mid %10d bytes;  count = %10d", size, g_allocCountMid++);
+  #endif
+  return MapBlock(size, GetNormalPageSize(), 0);
+}
+
+void MidFree(void *address)
+{
+  #ifdef _SZ_ALLOC_DEBUG
+  if (address != 0)
+    fprintf(stderr, "\nFree_Mid; count = %10d", --g_allocCountMid);
+  #endif
+  if (address == 0)
+    return;
+  UnmapBlock(address);
+}
+
+void *BigAlloc(size_t size)
+{
+  void *res;
+  if (size == 0)
+    return 0;
+  #ifdef _SZ_ALLOC_DEBUG
+  fprintf(stderr, "\nAlloc_Big %10d bytes;  count = %10d", size, g_allocCountBig++);
+  #endif
+
+  if (g_LargePageSize != 0 && size >= kLargeBlockMin)
+  {
+    #ifdef MAP_HUGETLB
+    res = MapBlock(size, g_LargePageSize, MAP_HUGETLB);
+    if (res != 0)
+      return SetBlockPages(res, BIG_ALLOC_PAGES_LARGE, g_LargePageSize);
+    #endif
+    #ifdef MADV_HUGEPAGE
+    if (g_TransparentPages)
+    {
+      res = MapBlockTransparent(size);
+      if (res != 0)
+        return SetBlockPages(res, BIG_ALLOC_PAGES_TRANSPARENT, g_LargePageSize);
+    }
+    #endif
+  }
+  /* malloc reuses the freed blocks, so the small buffers are not mapped again for each stream */
+  if (size > (size_t)0 - kBlockHeaderSize)
+    return 0;
+  res = MyAlloc(size + kBlockHeaderSize);
+  if (res == 0)
+    return 0;
+  ((CBlockHeader *)res)->mapSize = 0;
+  return SetBlockPages((char *)res + kBlockHeaderSize, BIG_ALLOC_PAGES_NORMAL, GetNormalPageSize());
+}
+
+void BigFree(void *address)
+{
+  #ifdef _SZ_ALLOC_DEBUG
+  if (address != 0)
+    fprintf(stderr, "\nFree_Big; count = %10d", --g_allocCountBig);
+  #endif
+  if (address == 0)
+    return;
+  UnmapBlock(address);
+}
+
+/* Linux: memfd_create gives the pages that are mapped twice over the reserved range.
+   Other systems return 0, the caller uses the normal buffer then. */
+
+void *RingAlloc(size_t size, size_t *ringSize)
+{
+  #if defined(__linux__) && defined(SYS_memfd_create)
+  size_t pageSize = GetNormalPageSize();
+  size_t ring = (size + pageSize - 1) & ~(pageSize - 1);
+  char *p;
+  int fd;
+  if (size == 0 || ring < size || ring > ((size_t)0 - 1) / 2)
+    return 0;
+  fd = (int)syscall(SYS_memfd_create, "LzmaRing", 1 /* MFD_CLOEXEC */);
+  if (fd < 0)
+    return 0;
+  p = (char *)MAP_FAILED;
+  if (ftruncate(fd, (off_t)ring) == 0)
+    p = (char *)mmap(0, ring * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p != (char *)MAP_FAILED)
+  {
+    if (mmap(p, ring, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED ||
+        mmap(p + ring, ring, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED)
+    {
+      munmap(p, ring * 2);
+      p = (char *)MAP_FAILED;
+    }
+  }
+  close(fd);
+  if (p == (char *)MAP_FAILED)
+    return 0;
+  *ringSize = ring;
+  return p;
+  #else
+  size = size;
+  ringSize = ringSize;
+  return 0;
+  #endif
+}
+
+void RingFree(void *address, size_t ringSize)
+{
+  if (address != 0)
+    munmap(address, ringSize * 2);
 }
 
 #endif
@@ -13,23 +13,37 @@ extern "C" {
 void *MyAlloc(size_t size);
 void MyFree(void *address);
 
-#ifdef _WIN32
+/* MidAlloc allocates whole pages: VirtualAlloc on Windows, mmap on other systems.
+   BigAlloc is the same on Windows, on other systems it uses malloc for normal pages.
+   SetLargePageSize enables large pages in BigAlloc for the blocks >= 256 KB:
+     Windows - VirtualAlloc(MEM_LARGE_PAGES), if _7ZIP_LARGE_PAGES is defined.
+     Linux   - mmap(MAP_HUGETLB) from the reserved pool, else transparent huge pages
+               (madvise(MADV_HUGEPAGE)) for the aligned block, else normal pages.
+   BigAlloc_SetLargePages(0) disables large pages, (1) calls SetLargePageSize.
+   It returns 1, if large pages are enabled.
+   BigAlloc_GetPages returns the kind of pages of the block of BigAlloc and their size. */
+
+#define BIG_ALLOC_PAGES_NORMAL 0
+#define BIG_ALLOC_PAGES_LARGE 1
+#define BIG_ALLOC_PAGES_TRANSPARENT 2
 
 void SetLargePageSize();
+int BigAlloc_SetLargePages(int enable);
+int BigAlloc_GetPages(const void *address, size_t *pageSize);
 
 void *MidAlloc(size_t size);
 void MidFree(void *address);
 void *BigAlloc(size_t size);
 void BigFree(void *address);
 
-#else
+/* RingAlloc maps the same (size rounded up to pages) bytes twice, one copy right
+   after the other, and returns that size in *ringSize: p[i] and p[i + *ringSize]
+   are the same byte, so a ring buffer can be read and written as contiguous memory.
+   It returns 0, if the system doesn't support it (Linux memfd_create and Windows
+   file mappings are used). */
 
-#define MidAlloc(size) MyAlloc(size)
-#define MidFree(address) MyFree(address)
-#define BigAlloc(size) MyAlloc(size)
-#define BigFree(address) MyFree(address)
-
-#endif
+void *RingAlloc(size_t size, size_t *ringSize);
+void RingFree(void *address, size_t ringSize);
 
 #ifdef __cplusplus
 }
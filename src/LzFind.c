@@ -3,8 +3,10 @@
 
 #include <string.h>
 
+#include "Alloc.h"
 #include "LzFind.h"
 #include "LzHash.h"
+#include "LzMatchLen.h"
 
 #define kEmptyHashValue 0
 #define kMaxValForNormalize ((UInt32)0xFFFFFFFF)
@@ -18,8 +20,12 @@ static void LzInWindow_Free(CMatchFinder *p, ISzAlloc *alloc)
 {
   if (!p->directInput)
   {
-    alloc->Free(alloc, p->bufferBase);
+    if (p->ringBase != 0)
+      RingFree(p->ringBase, p->ringSize);
+    else
+      alloc->Free(alloc, p->bufferBase);
     p->bufferBase = 0;
+    p->ringBase = 0;
   }
 }
 
@@ -33,15 +39,25 @@ static int LzInWindow_Create(CMatchFinder *p, UInt32 keepSizeReserv, ISzAlloc *a
     p->blockSize = blockSize;
     return 1;
   }
-  if (p->bufferBase == 0 || p->blockSize != blockSize)
+  if (p->bufferBase == 0 || p->blockSize != blockSize || (p->ringBase != 0 && !p->ringWindow))
   {
     LzInWindow_Free(p, alloc);
     p->blockSize = blockSize;
-    p->bufferBase = (Byte *)alloc->Alloc(alloc, (size_t)blockSize);
+    if (p->ringWindow)
+      p->ringBase = (Byte *)RingAlloc((size_t)blockSize, &p->ringSize);
+    if (p->ringBase != 0)
+      p->bufferBase = p->ringBase;
+    else
+      p->bufferBase = (Byte *)alloc->Alloc(alloc, (size_t)blockSize);
   }
   return (p->bufferBase != 0);
 }
 
+void MatchFinder_FreeWindow(CMatchFinder *p, ISzAlloc *alloc)
+{
+  LzInWindow_Free(p, alloc);
+}
+
 Byte *MatchFinder_GetPointerToCurrentPos(CMatchFinder *p) { return p->buffer; }
 Byte MatchFinder_GetIndexByte(CMatchFinder *p, Int32 index) { return p->buffer[index]; }
 
@@ -60,7 +76,8 @@ static void MatchFinder_ReadBlock(CMatchFinder *p)
     return;
   if (p->directInput)
   {
-    UInt32 curSize = 0xFFFFFFFF - p->streamPos;
+    /* streamPos wraps after 4 GB: only (streamPos - pos) must fit in 32 bits */
+    UInt32 curSize = 0xFFFFFFFF - (p->streamPos - p->pos);
     if (curSize > p->directInputRem)
       curSize = (UInt32)p->directInputRem;
     p->directInputRem -= curSize;
@@ -89,8 +106,23 @@ static void MatchFinder_ReadBlock(CMatchFinder *p)
   }
 }
 
+/* With the ring window (ringSize >= blockSize) the data before (ringBase + ringSize)
+   is also after it, so only bufferBase moves, and the pointers move back by ringSize
+   near the end of the double mapping. The writes of MatchFinder_ReadBlock to
+   [bufferBase, bufferBase + blockSize) don't touch the window through the other copy. */
+
 void MatchFinder_MoveBlock(CMatchFinder *p)
 {
+  if (p->ringBase != 0)
+  {
+    p->bufferBase = p->buffer - p->keepSizeBefore;
+    if ((size_t)(p->bufferBase - p->ringBase) + p->blockSize > p->ringSize * 2)
+    {
+      p->bufferBase -= p->ringSize;
+      p->buffer -= p->ringSize;
+    }
+    return;
+  }
   memmove(p->bufferBase,
     p->buffer - p->keepSizeBefore,
     (size_t)(p->streamPos - p->pos + p->keepSizeBefore));
@@ -135,7 +167,11 @@ void MatchFinder_Construct(CMatchFinder *p)
   UInt32 i;
   p->bufferBase = 0;
   p->directInput = 0;
+  p->ringWindow = 0;
+  p->ringBase = 0;
+  p->ringSize = 0;
   p->hash = 0;
+  p->hashIsValid = 0;
   MatchFinder_SetDefaultSettings(p);
 
   for (i = 0; i < 256; i++)
@@ -146,12 +182,14 @@ void MatchFinder_Construct(CMatchFinder *p)
       r = (r >> 1) ^ (kCrcPoly & ~((r & 1) - 1));
     p->crc[i] = r;
   }
+  LzMatchLen_Init();
 }
 
 static void MatchFinder_FreeThisClassMemory(CMatchFinder *p, ISzAlloc *alloc)
 {
   alloc->Free(alloc, p->hash);
   p->hash = 0;
+  p->hashIsValid = 0;
 }
 
 void MatchFinder_Free(CMatchFinder *p, ISzAlloc *alloc)
@@ -168,6 +206,60 @@ static CLzRef* AllocRefs(UInt32 num, ISzAlloc *alloc)
   return (CLzRef *)alloc->Alloc(alloc, sizeInBytes);
 }
 
+static UInt32 MatchFinder_GetSizeReserv(UInt32 historySize,
+    UInt32 keepAddBufferBefore, UInt32 matchMaxLen, UInt32 keepAddBufferAfter)
+{
+  UInt32 sizeReserv = historySize >> 1;
+  if (historySize > ((UInt32)2 << 30))
+    sizeReserv = historySize >> 2;
+  return sizeReserv + (keepAddBufferBefore + matchMaxLen + keepAddBufferAfter) / 2 + (1 << 19);
+}
+
+static UInt32 MatchFinder_GetHashMask(UInt32 numHashBytes, UInt32 historySize)
+{
+  UInt32 hs;
+  if (numHashBytes == 2)
+    return (1 << 16) - 1;
+  hs = historySize - 1;
+  hs |= (hs >> 1);
+  hs |= (hs >> 2);
+  hs |= (hs >> 4);
+  hs |= (hs >> 8);
+  hs >>= 1;
+  hs |= 0xFFFF; /* don't change it! It's required for Deflate */
+  if (hs > (1 << 24))
+  {
+    if (numHashBytes == 3)
+      hs = (1 << 24) - 1;
+    else
+      hs >>= 1;
+  }
+  return hs;
+}
+
+static UInt32 MatchFinder_GetFixedHashSize(UInt32 numHashBytes)
+{
+  UInt32 size = 0;
+  if (numHashBytes > 2) size += kHash2Size;
+  if (numHashBytes > 3) size += kHash3Size;
+  if (numHashBytes > 4) size += kHash4Size;
+  return size;
+}
+
+UInt64 MatchFinder_EstimateMemory(UInt32 historySize,
+    UInt32 keepAddBufferBefore, UInt32 matchMaxLen, UInt32 keepAddBufferAfter,
+    UInt32 numHashBytes, int btMode, int directInput)
+{
+  UInt64 numRefs = (UInt64)MatchFinder_GetHashMask(numHashBytes, historySize) + 1 +
+      MatchFinder_GetFixedHashSize(numHashBytes) +
+      ((UInt64)historySize + 1) * (btMode ? 2 : 1);
+  UInt64 size = numRefs * sizeof(CLzRef);
+  if (!directInput)
+    size += (UInt64)historySize + keepAddBufferBefore + 1 + matchMaxLen + keepAddBufferAfter +
+        MatchFinder_GetSizeReserv(historySize, keepAddBufferBefore, matchMaxLen, keepAddBufferAfter);
+  return size;
+}
+
 int MatchFinder_Create(CMatchFinder *p, UInt32 historySize,
     UInt32 keepAddBufferBefore, UInt32 matchMaxLen, UInt32 keepAddBufferAfter,
     ISzAlloc *alloc)
@@ -178,10 +270,7 @@ int MatchFinder_Create(CMatchFinder *p, UInt32 historySize,
     MatchFinder_Free(p, alloc);
     return 0;
   }
-  sizeReserv = historySize >> 1;
-  if (historySize > ((UInt32)2 << 30))
-    sizeReserv = historySize >> 2;
-  sizeReserv += (keepAddBufferBefore + matchMaxLen + keepAddBufferAfter) / 2 + (1 << 19);
+  sizeReserv = MatchFinder_GetSizeReserv(historySize, keepAddBufferBefore, matchMaxLen, keepAddBufferAfter);
 
   p->keepSizeBefore = historySize + keepAddBufferBefore + 1;
   p->keepSizeAfter = matchMaxLen + keepAddBufferAfter;
@@ -191,45 +280,25 @@ int MatchFinder_Create(CMatchFinder *p, UInt32 historySize,
     UInt32 newCyclicBufferSize = historySize + 1;
     UInt32 hs;
     p->matchMaxLen = matchMaxLen;
-    {
-      p->fixedHashSize = 0;
-      if (p->numHashBytes == 2)
-        hs = (1 << 16) - 1;
-      else
-      {
-        hs = historySize - 1;
-        hs |= (hs >> 1);
-        hs |= (hs >> 2);
-        hs |= (hs >> 4);
-        hs |= (hs >> 8);
-        hs >>= 1;
-        hs |= 0xFFFF; /* don't change it! It's required for Deflate */
-        if (hs > (1 << 24))
-        {
-          if (p->numHashBytes == 3)
-            hs = (1 << 24) - 1;
-          else
-            hs >>= 1;
-        }
-      }
-      p->hashMask = hs;
-      hs++;
-      if (p->numHashBytes > 2) p->fixedHashSize += kHash2Size;
-      if (p->numHashBytes > 3) p->fixedHashSize += kHash3Size;
-      if (p->numHashBytes > 4) p->fixedHashSize += kHash4Size;
-      hs += p->fixedHashSize;
-    }
+    p->hashMask = MatchFinder_GetHashMask(p->numHashBytes, historySize);
+    p->fixedHashSize = MatchFinder_GetFixedHashSize(p->numHashBytes);
+    hs = p->hashMask + 1 + p->fixedHashSize;
 
     {
       UInt32 prevSize = p->hashSizeSum + p->numSons;
       UInt32 newSize;
+      if (p->hashSizeSum != hs)
+        p->hashIsValid = 0;
       p->historySize = historySize;
       p->hashSizeSum = hs;
       p->cyclicBufferSize = newCyclicBufferSize;
       p->numSons = (p->btMode ? newCyclicBufferSize * 2 : newCyclicBufferSize);
       newSize = p->hashSizeSum + p->numSons;
       if (p->hash != 0 && prevSize == newSize)
+      {
+        p->son = p->hash + p->hashSizeSum;
         return 1;
+      }
       MatchFinder_FreeThisClassMemory(p, alloc);
       p->hash = AllocRefs(newSize, alloc);
       if (p->hash != 0)
@@ -268,14 +337,28 @@ static void MatchFinder_SetLimits(CMatchFinder *p)
   p->posLimit = p->pos + limit;
 }
 
+/* All references in hash[] and son[] are smaller than pos. If the tables were
+   cleared before, the new stream can start at (pos + cyclicBufferSize) instead:
+   the old references are out of the window there, so the O(hashSize) clearing
+   is required only for new tables and near the normalization limit. */
+
 void MatchFinder_Init(CMatchFinder *p)
 {
-  UInt32 i;
-  for (i = 0; i < p->hashSizeSum; i++)
-    p->hash[i] = kEmptyHashValue;
+  if (p->hashIsValid && kMaxValForNormalize - p->pos > p->cyclicBufferSize + p->keepSizeAfter)
+    p->pos += p->cyclicBufferSize;
+  else
+  {
+    UInt32 i;
+    for (i = 0; i < p->hashSizeSum; i++)
+      p->hash[i] = kEmptyHashValue;
+    p->hashIsValid = 1;
+    p->pos = p->cyclicBufferSize;
+  }
   p->cyclicBufferPos = 0;
+  if (p->ringBase != 0)
+    p->bufferBase = p->ringBase;
   p->buffer = p->bufferBase;
-  p->pos = p->streamPos = p->cyclicBufferSize;
+  p->streamPos = p->pos;
   p->result = SZ_OK;
   p->streamEndWasReached = 0;
   MatchFinder_ReadBlock(p);
@@ -334,10 +417,7 @@ static UInt32 * Hc_GetMatchesSpec(UInt32 lenLimit, UInt32 curMatch, UInt32 pos,
       curMatch = son[_cyclicBufferPos - delta + ((delta > _cyclicBufferPos) ? _cyclicBufferSize : 0)];
       if (pb[maxLen] == cur[maxLen] && *pb == *cur)
       {
-        UInt32 len = 0;
-        while (++len != lenLimit)
-          if (pb[len] != cur[len])
-            break;
+        UInt32 len = LzMatchLen(pb, cur, 1, lenLimit);
         if (maxLen < len)
         {
           *distances++ = maxLen = len;
@@ -371,10 +451,7 @@ UInt32 * GetMatchesSpec1(UInt32 lenLimit, UInt32 curMatch, UInt32 pos, const Byt
       UInt32 len = (len0 < len1 ? len0 : len1);
       if (pb[len] == cur[len])
       {
-        if (++len != lenLimit && pb[len] == cur[len])
-          while (++len != lenLimit)
-            if (pb[len] != cur[len])
-              break;
+        len = LzMatchLen(pb, cur, len + 1, lenLimit);
         if (maxLen < len)
         {
           *distances++ = maxLen = len;
@@ -425,9 +502,7 @@ static void SkipMatchesSpec(UInt32 lenLimit, UInt32 curMatch, UInt32 pos, const
       UInt32 len = (len0 < len1 ? len0 : len1);
       if (pb[len] == cur[len])
       {
-        while (++len != lenLimit)
-          if (pb[len] != cur[len])
-            break;
+        len = LzMatchLen(pb, cur, len + 1, lenLimit);
         {
           if (len == lenLimit)
           {
@@ -521,9 +596,7 @@ static UInt32 Bt3_MatchFinder_GetMatches(CMatchFinder *p, UInt32 *distances)
   offset = 0;
   if (delta2 < p->cyclicBufferSize && *(cur - delta2) == *cur)
   {
-    for (; maxLen != lenLimit; maxLen++)
-      if (cur[(ptrdiff_t)maxLen - delta2] != cur[maxLen])
-        break;
+    maxLen = LzMatchLen(cur - delta2, cur, maxLen, lenLimit);
     distances[0] = maxLen;
     distances[1] = delta2 - 1;
     offset = 2;
@@ -568,9 +641,7 @@ static UInt32 Bt4_MatchFinder_GetMatches(CMatchFinder *p, UInt32 *distances)
   }
   if (offset != 0)
   {
-    for (; maxLen != lenLimit; maxLen++)
-      if (cur[(ptrdiff_t)maxLen - delta2] != cur[maxLen])
-        break;
+    maxLen = LzMatchLen(cur - delta2, cur, maxLen, lenLimit);
     distances[offset - 2] = maxLen;
     if (maxLen == lenLimit)
     {
@@ -615,9 +686,7 @@ static UInt32 Hc4_MatchFinder_GetMatches(CMatchFinder *p, UInt32 *distances)
   }
   if (offset != 0)
   {
-    for (; maxLen != lenLimit; maxLen++)
-      if (cur[(ptrdiff_t)maxLen - delta2] != cur[maxLen])
-        break;
+    maxLen = LzMatchLen(cur - delta2, cur, maxLen, lenLimit);
     distances[offset - 2] = maxLen;
     if (maxLen == lenLimit)
     {
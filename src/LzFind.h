@@ -37,6 +37,10 @@ typedef struct _CMatchFinder
   UInt32 keepSizeBefore;
   UInt32 keepSizeAfter;
 
+  int ringWindow; /* the window of the stream is RingAlloc'ed, if the system allows it */
+  Byte *ringBase; /* then bufferBase moves inside the double mapping instead of memmove */
+  size_t ringSize;
+
   UInt32 numHashBytes;
   int directInput;
   size_t directInputRem;
@@ -46,6 +50,7 @@ typedef struct _CMatchFinder
   UInt32 fixedHashSize;
   UInt32 hashSizeSum;
   UInt32 numSons;
+  int hashIsValid; /* hash[] holds only references below pos: MatchFinder_Init can skip the clearing */
   SRes result;
   UInt32 crc[256];
 } CMatchFinder;
@@ -61,6 +66,7 @@ void MatchFinder_MoveBlock(CMatchFinder *p);
 void MatchFinder_ReadIfRequired(CMatchFinder *p);
 
 void MatchFinder_Construct(CMatchFinder *p);
+void MatchFinder_FreeWindow(CMatchFinder *p, ISzAlloc *alloc);
 
 /* Conditions:
      historySize <= 3 GB
@@ -70,6 +76,12 @@ int MatchFinder_Create(CMatchFinder *p, UInt32 historySize,
     UInt32 keepAddBufferBefore, UInt32 matchMaxLen, UInt32 keepAddBufferAfter,
     ISzAlloc *alloc);
 void MatchFinder_Free(CMatchFinder *p, ISzAlloc *alloc);
+
+/* MatchFinder_EstimateMemory returns the size of the blocks that MatchFinder_Create
+   allocates with these parameters. There is no window buffer in directInput mode. */
+UInt64 MatchFinder_EstimateMemory(UInt32 historySize,
+    UInt32 keepAddBufferBefore, UInt32 matchMaxLen, UInt32 keepAddBufferAfter,
+    UInt32 numHashBytes, int btMode, int directInput);
 void MatchFinder_Normalize3(UInt32 subValue, CLzRef *items, UInt32 numItems);
 void MatchFinder_ReduceOffsets(CMatchFinder *p, UInt32 subValue);
 
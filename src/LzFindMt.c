@@ -2,9 +2,59 @@
 2009-09-20 : Igor Pavlov : Public domain */
 
 #include "LzHash.h"
+#include "LzMatchLen.h"
 
 #include "LzFindMt.h"
 
+#define kMtSpinCountMin (1 << 4)
+#define kMtSpinCountMax (1 << 12)
+
+static void MtWaiter_Construct(CMtWaiter *p)
+{
+  p->waiting = 0;
+  p->spinCount = kMtSpinCountMin;
+  Event_Construct(&p->event);
+}
+
+/* MtWaiter_Wait waits until (*value != oldValue) or (*stop != 0).
+   It spins first. The spin count grows when spinning was enough and
+   it shrinks when the thread had to sleep. */
+
+static void MtWaiter_Wait(CMtWaiter *p, volatile UInt32 *value, UInt32 oldValue, Bool *stop)
+{
+  UInt32 i;
+  for (i = 0; i < p->spinCount; i++)
+  {
+    if (Atomic_Load32(value) != oldValue || (stop && Atomic_Load32(stop)))
+    {
+      if (p->spinCount < kMtSpinCountMax)
+        p->spinCount <<= 1;
+      return;
+    }
+    Thread_Pause();
+  }
+  if (p->spinCount > kMtSpinCountMin)
+    p->spinCount >>= 1;
+  for (;;)
+  {
+    Atomic_Store32(&p->waiting, 1);
+    if (Atomic_Load32(value) != oldValue || (stop && Atomic_Load32(stop)))
+    {
+      /* the event can stay signaled here. It's not a problem,
+         since the condition is always checked after Event_Wait. */
+      Atomic_Store32(&p->waiting, 0);
+      return;
+    }
+    Event_Wait(&p->event);
+  }
+}
+
+static void MtWaiter_Wake(CMtWaiter *p)
+{
+  if (Atomic_Exchange32(&p->waiting, 0) != 0)
+    Event_Set(&p->event);
+}
+
 void MtSync_Construct(CMtSync *p)
 {
   p->wasCreated = False;
@@ -14,8 +64,27 @@ void MtSync_Construct(CMtSync *p)
   Event_Construct(&p->canStart);
   Event_Construct(&p->wasStarted);
   Event_Construct(&p->wasStopped);
-  Semaphore_Construct(&p->freeSemaphore);
-  Semaphore_Construct(&p->filledSemaphore);
+  MtWaiter_Construct(&p->producer);
+  MtWaiter_Construct(&p->consumer);
+}
+
+/* MtSync_WaitFree is called by producer thread before it writes the block (index).
+   It returns False, if consumer has requested to stop writing. */
+
+static Bool MtSync_WaitFree(CMtSync *p, UInt32 index)
+{
+  UInt32 oldValue = index - p->numBlocks;
+  if (Atomic_Load32(&p->numFreedBlocks) == oldValue)
+    MtWaiter_Wait(&p->producer, &p->numFreedBlocks, oldValue, &p->stopWriting);
+  return !Atomic_Load32(&p->stopWriting);
+}
+
+/* MtSync_PutBlock is called by producer thread after it has written the block (numBlocks - 1) */
+
+static void MtSync_PutBlock(CMtSync *p, UInt32 numBlocks)
+{
+  Atomic_Store32(&p->numFilledBlocks, numBlocks);
+  MtWaiter_Wake(&p->consumer);
 }
 
 void MtSync_GetNextBlock(CMtSync *p)
@@ -26,6 +95,10 @@ void MtSync_GetNextBlock(CMtSync *p)
     p->needStart = False;
     p->stopWriting = False;
     p->exit = False;
+    p->numFilledBlocks = 0;
+    p->numFreedBlocks = 0;
+    p->producer.waiting = 0;
+    p->consumer.waiting = 0;
     Event_Reset(&p->wasStarted);
     Event_Reset(&p->wasStopped);
 
@@ -37,9 +110,11 @@ void MtSync_GetNextBlock(CMtSync *p)
     CriticalSection_Leave(&p->cs);
     p->csWasEntered = False;
     p->numProcessedBlocks++;
-    Semaphore_Release1(&p->freeSemaphore);
+    Atomic_Store32(&p->numFreedBlocks, p->numProcessedBlocks - 1);
+    MtWaiter_Wake(&p->producer);
   }
-  Semaphore_Wait(&p->filledSemaphore);
+  if (Atomic_Load32(&p->numFilledBlocks) == p->numProcessedBlocks - 1)
+    MtWaiter_Wait(&p->consumer, &p->numFilledBlocks, p->numProcessedBlocks - 1, NULL);
   CriticalSection_Enter(&p->cs);
   p->csWasEntered = True;
 }
@@ -48,24 +123,19 @@ void MtSync_GetNextBlock(CMtSync *p)
 
 void MtSync_StopWriting(CMtSync *p)
 {
-  UInt32 myNumBlocks = p->numProcessedBlocks;
   if (!Thread_WasCreated(&p->thread) || p->needStart)
     return;
-  p->stopWriting = True;
+  Atomic_Store32(&p->stopWriting, True);
   if (p->csWasEntered)
   {
     CriticalSection_Leave(&p->cs);
     p->csWasEntered = False;
   }
-  Semaphore_Release1(&p->freeSemaphore);
+  MtWaiter_Wake(&p->producer);
  
   Event_Wait(&p->wasStopped);
 
-  while (myNumBlocks++ != p->numProcessedBlocks)
-  {
-    Semaphore_Wait(&p->filledSemaphore);
-    Semaphore_Release1(&p->freeSemaphore);
-  }
+  /* the block counters are reset by next MtSync_GetNextBlock() */
   p->needStart = True;
 }
 
@@ -89,15 +159,15 @@ void MtSync_Destruct(CMtSync *p)
   Event_Close(&p->canStart);
   Event_Close(&p->wasStarted);
   Event_Close(&p->wasStopped);
-  Semaphore_Close(&p->freeSemaphore);
-  Semaphore_Close(&p->filledSemaphore);
+  Event_Close(&p->producer.event);
+  Event_Close(&p->consumer.event);
 
   p->wasCreated = False;
 }
 
 #define RINOK_THREAD(x) { if ((x) != 0) return SZ_ERROR_THREAD; }
 
-static SRes MtSync_Create2(CMtSync *p, unsigned (MY_STD_CALL *startAddress)(void *), void *obj, UInt32 numBlocks)
+static SRes MtSync_Create2(CMtSync *p, THREAD_FUNC_TYPE startAddress, void *obj, UInt32 numBlocks)
 {
   if (p->wasCreated)
     return SZ_OK;
@@ -109,8 +179,9 @@ static SRes MtSync_Create2(CMtSync *p, unsigned (MY_STD_CALL *startAddress)(void
   RINOK_THREAD(AutoResetEvent_CreateNotSignaled(&p->wasStarted));
   RINOK_THREAD(AutoResetEvent_CreateNotSignaled(&p->wasStopped));
   
-  RINOK_THREAD(Semaphore_Create(&p->freeSemaphore, numBlocks, numBlocks));
-  RINOK_THREAD(Semaphore_Create(&p->filledSemaphore, 0, numBlocks));
+  RINOK_THREAD(AutoResetEvent_CreateNotSignaled(&p->producer.event));
+  RINOK_THREAD(AutoResetEvent_CreateNotSignaled(&p->consumer.event));
+  p->numBlocks = numBlocks;
 
   p->needStart = True;
   
@@ -119,7 +190,7 @@ static SRes MtSync_Create2(CMtSync *p, unsigned (MY_STD_CALL *startAddress)(void
   return SZ_OK;
 }
 
-static SRes MtSync_Create(CMtSync *p, unsigned (MY_STD_CALL *startAddress)(void *), void *obj, UInt32 numBlocks)
+static SRes MtSync_Create(CMtSync *p, THREAD_FUNC_TYPE startAddress, void *obj, UInt32 numBlocks)
 {
   SRes res = MtSync_Create2(p, startAddress, obj, numBlocks);
   if (res != SZ_OK)
@@ -139,12 +210,31 @@ const UInt32 value = (v); p++; *heads++ = pos - hash[value]; hash[value] = pos++
 
 #define DEF_GetHeads(name, v) DEF_GetHeads2(name, v, ;)
 
-DEF_GetHeads2(2,  (p[0] | ((UInt32)p[1] << 8)), hashMask = hashMask; crc = crc; )
-DEF_GetHeads(3,  (crc[p[0]] ^ p[1] ^ ((UInt32)p[2] << 8)) & hashMask)
-DEF_GetHeads(4,  (crc[p[0]] ^ p[1] ^ ((UInt32)p[2] << 8) ^ (crc[p[3]] << 5)) & hashMask)
-DEF_GetHeads(4b, (crc[p[0]] ^ p[1] ^ ((UInt32)p[2] << 8) ^ ((UInt32)p[3] << 16)) & hashMask)
+#define HEADS_HASH_2  (p[0] | ((UInt32)p[1] << 8))
+#define HEADS_HASH_3  ((crc[p[0]] ^ p[1] ^ ((UInt32)p[2] << 8)) & hashMask)
+#define HEADS_HASH_4  ((crc[p[0]] ^ p[1] ^ ((UInt32)p[2] << 8) ^ (crc[p[3]] << 5)) & hashMask)
+#define HEADS_HASH_4b ((crc[p[0]] ^ p[1] ^ ((UInt32)p[2] << 8) ^ ((UInt32)p[3] << 16)) & hashMask)
+
+DEF_GetHeads2(2,  HEADS_HASH_2, hashMask = hashMask; crc = crc; )
+DEF_GetHeads(3,  HEADS_HASH_3)
+DEF_GetHeads(4,  HEADS_HASH_4)
+DEF_GetHeads(4b, HEADS_HASH_4b)
 /* DEF_GetHeads(5,  (crc[p[0]] ^ p[1] ^ ((UInt32)p[2] << 8) ^ (crc[p[3]] << 5) ^ (crc[p[4]] << 3)) & hashMask) */
 
+/* GetHashValue* return the same hash value as GetHeads* for one position.
+   BT workers use it to select the trees that belong to them. */
+
+#define DEF_GetHashValue2(name, v, action) \
+static UInt32 GetHashValue ## name(const Byte *p, UInt32 hashMask, const UInt32 *crc) \
+{ action; return (v); }
+
+#define DEF_GetHashValue(name, v) DEF_GetHashValue2(name, v, ;)
+
+DEF_GetHashValue2(2, HEADS_HASH_2, hashMask = hashMask; crc = crc; )
+DEF_GetHashValue(3,  HEADS_HASH_3)
+DEF_GetHashValue(4,  HEADS_HASH_4)
+DEF_GetHashValue(4b, HEADS_HASH_4b)
+
 void HashThreadFunc(CMatchFinderMt *mt)
 {
   CMtSync *p = &mt->hashSync;
@@ -157,9 +247,8 @@ void HashThreadFunc(CMatchFinderMt *mt)
     {
       if (p->exit)
         return;
-      if (p->stopWriting)
+      if (Atomic_Load32(&p->stopWriting))
       {
-        p->numProcessedBlocks = numProcessedBlocks;
         Event_Set(&p->wasStopped);
         break;
       }
@@ -183,7 +272,8 @@ void HashThreadFunc(CMatchFinderMt *mt)
           continue;
         }
 
-        Semaphore_Wait(&p->freeSemaphore);
+        if (!MtSync_WaitFree(p, numProcessedBlocks))
+          continue;
 
         MatchFinder_ReadIfRequired(mf);
         if (mf->pos > (kMtMaxValForNormalize - kMtHashBlockSize))
@@ -210,7 +300,7 @@ void HashThreadFunc(CMatchFinderMt *mt)
         }
       }
 
-      Semaphore_Release1(&p->filledSemaphore);
+      MtSync_PutBlock(p, numProcessedBlocks);
     }
   }
 }
@@ -259,10 +349,7 @@ Int32 NO_INLINE GetMatchesSpecN(UInt32 lenLimit, UInt32 pos, const Byte *cur, CL
       UInt32 len = (len0 < len1 ? len0 : len1);
       if (pb[len] == cur[len])
       {
-        if (++len != lenLimit && pb[len] == cur[len])
-          while (++len != lenLimit)
-            if (pb[len] != cur[len])
-              break;
+        len = LzMatchLen(pb, cur, len + 1, lenLimit);
         if (maxLen < len)
         {
           *distances++ = maxLen = len;
@@ -377,6 +464,180 @@ void BtGetMatches(CMatchFinderMt *p, UInt32 *distances)
   distances[0] = curPos;
 }
 
+/* BtGetMatchesSpecW is GetMatchesSpec1 that doesn't visit the positions
+   with (delta >= window). The window is (cyclicBufferSize - btJobSize),
+   so the nodes that can be visited are never overwritten by other BT threads
+   in the same job. */
+
+static UInt32 * BtGetMatchesSpecW(UInt32 lenLimit, UInt32 curMatch, UInt32 pos, const Byte *cur, CLzRef *son,
+    UInt32 _cyclicBufferPos, UInt32 _cyclicBufferSize, UInt32 window, UInt32 cutValue,
+    UInt32 *distances, UInt32 maxLen)
+{
+  CLzRef *ptr0 = son + (_cyclicBufferPos << 1) + 1;
+  CLzRef *ptr1 = son + (_cyclicBufferPos << 1);
+  UInt32 len0 = 0, len1 = 0;
+  for (;;)
+  {
+    UInt32 delta = pos - curMatch;
+    if (cutValue-- == 0 || delta >= window)
+    {
+      *ptr0 = *ptr1 = kEmptyHashValue;
+      return distances;
+    }
+    {
+      CLzRef *pair = son + ((_cyclicBufferPos - delta + ((delta > _cyclicBufferPos) ? _cyclicBufferSize : 0)) << 1);
+      const Byte *pb = cur - delta;
+      UInt32 len = (len0 < len1 ? len0 : len1);
+      if (pb[len] == cur[len])
+      {
+        len = LzMatchLen(pb, cur, len + 1, lenLimit);
+        if (maxLen < len)
+        {
+          *distances++ = maxLen = len;
+          *distances++ = delta - 1;
+          if (len == lenLimit)
+          {
+            *ptr1 = pair[0];
+            *ptr0 = pair[1];
+            return distances;
+          }
+        }
+      }
+      if (pb[len] < cur[len])
+      {
+        *ptr1 = curMatch;
+        ptr1 = pair + 1;
+        curMatch = *ptr1;
+        len1 = len;
+      }
+      else
+      {
+        *ptr0 = curMatch;
+        ptr0 = pair;
+        curMatch = *ptr0;
+        len0 = len;
+      }
+    }
+  }
+}
+
+/* BtJobProcess writes the matches for the positions of the current job
+   that belong to BT thread (index) to btJobBuf: (btJobStride) items per position. */
+
+static void BtJobProcess(CMatchFinderMt *p, UInt32 index)
+{
+  UInt32 numThreads = p->numBtWorkers + 1;
+  UInt32 window = p->cyclicBufferSize - p->btJobSize;
+  UInt32 hashMask = p->MatchFinder->hashMask;
+  UInt32 i;
+  for (i = 0; i < p->btJobNum; i++)
+  {
+    const Byte *cur = p->btJobBuffer + i;
+    if (p->GetHashValueFunc(cur, hashMask, p->crc) % numThreads == index)
+    {
+      UInt32 *startDistances = p->btJobBuf + (size_t)i * p->btJobStride;
+      UInt32 pos = p->btJobStartPos + i;
+      *startDistances = (UInt32)(BtGetMatchesSpecW(p->btJobLenLimit, pos - p->btJobHeads[i],
+          pos, cur, p->son, p->btJobCyclicBufferPos + i, p->cyclicBufferSize, window, p->cutValue,
+          startDistances + 1, p->numHashBytes - 1) - startDistances) - 1;
+    }
+  }
+}
+
+static THREAD_FUNC_DECL BtWorkerThreadFunc(void *pp)
+{
+  CMtBtWorker *w = (CMtBtWorker *)pp;
+  CMatchFinderMt *mt = w->mt;
+  for (;;)
+  {
+    Event_Wait(&w->canStart);
+    if (mt->btWorkersExit)
+      return 0;
+    BtJobProcess(mt, w->index);
+    Event_Set(&w->wasFinished);
+  }
+}
+
+static void BtRunJob(CMatchFinderMt *p, UInt32 size, UInt32 lenLimit)
+{
+  UInt32 i;
+  p->btJobNum = size;
+  p->btJobPos = 0;
+  p->btJobStartPos = p->pos;
+  p->btJobCyclicBufferPos = p->cyclicBufferPos;
+  p->btJobLenLimit = lenLimit;
+  p->btJobBuffer = p->buffer;
+  p->btJobHeads = p->hashBuf + p->hashBufPos;
+
+  for (i = 0; i < p->numBtWorkers; i++)
+    Event_Set(&p->btWorkers[i].canStart);
+  BtJobProcess(p, 0);
+  for (i = 0; i < p->numBtWorkers; i++)
+    Event_Wait(&p->btWorkers[i].wasFinished);
+
+  p->hashBufPos += size;
+  p->buffer += size;
+  p->pos += size;
+  p->hashNumAvail -= size;
+  p->cyclicBufferPos += size;
+  if (p->cyclicBufferPos == p->cyclicBufferSize)
+    p->cyclicBufferPos = 0;
+}
+
+/* BtGetMatchesN is BtGetMatches for (numBtWorkers != 0).
+   The results of the job can be written to several btBuf blocks. */
+
+static void BtGetMatchesN(CMatchFinderMt *p, UInt32 *distances)
+{
+  UInt32 numProcessed = 0;
+  UInt32 curPos = 2;
+  UInt32 limit = kMtBtBlockSize - (p->matchMaxLen * 2);
+  distances[1] = p->hashNumAvail + (p->btJobNum - p->btJobPos);
+  while (curPos < limit)
+  {
+    if (p->btJobPos == p->btJobNum)
+    {
+      UInt32 size, lenLimit;
+      if (p->hashBufPos == p->hashBufPosLimit)
+      {
+        MatchFinderMt_GetNextBlock_Hash(p);
+        distances[1] = numProcessed + p->hashNumAvail;
+        if (p->hashNumAvail >= p->numHashBytes)
+          continue;
+        for (; p->hashNumAvail != 0; p->hashNumAvail--)
+          distances[curPos++] = 0;
+        break;
+      }
+      size = p->hashBufPosLimit - p->hashBufPos;
+      lenLimit = p->matchMaxLen;
+      if (lenLimit >= p->hashNumAvail)
+        lenLimit = p->hashNumAvail;
+      {
+        UInt32 size2 = p->hashNumAvail - lenLimit + 1;
+        if (size2 < size)
+          size = size2;
+        size2 = p->cyclicBufferSize - p->cyclicBufferPos;
+        if (size2 < size)
+          size = size2;
+        if (p->btJobSize < size)
+          size = p->btJobSize;
+      }
+      BtRunJob(p, size, lenLimit);
+    }
+    {
+      const UInt32 *src = p->btJobBuf + (size_t)(p->btJobPos++) * p->btJobStride;
+      UInt32 num = *src + 1;
+      UInt32 *dest = distances + curPos;
+      curPos += num;
+      numProcessed++;
+      do
+        *dest++ = *src++;
+      while (--num != 0);
+    }
+  }
+  distances[0] = curPos;
+}
+
 void BtFillBlock(CMatchFinderMt *p, UInt32 globalBlockIndex)
 {
   CMtSync *sync = &p->hashSync;
@@ -386,9 +647,13 @@ void BtFillBlock(CMatchFinderMt *p, UInt32 globalBlockIndex)
     sync->csWasEntered = True;
   }
   
-  BtGetMatches(p, p->btBuf + (globalBlockIndex & kMtBtNumBlocksMask) * kMtBtBlockSize);
+  if (p->numBtWorkers != 0)
+    BtGetMatchesN(p, p->btBuf + (globalBlockIndex & kMtBtNumBlocksMask) * kMtBtBlockSize);
+  else
+    BtGetMatches(p, p->btBuf + (globalBlockIndex & kMtBtNumBlocksMask) * kMtBtBlockSize);
 
-  if (p->pos > kMtMaxValForNormalize - kMtBtBlockSize)
+  /* BtGetMatchesN can process one job more than fits to the block */
+  if (p->pos > kMtMaxValForNormalize - kMtBtBlockSize - kMtBtJobSize)
   {
     UInt32 subValue = p->pos - p->cyclicBufferSize;
     MatchFinder_Normalize3(subValue, p->son, p->cyclicBufferSize * 2);
@@ -414,16 +679,16 @@ void BtThreadFunc(CMatchFinderMt *mt)
     {
       if (p->exit)
         return;
-      if (p->stopWriting)
+      if (Atomic_Load32(&p->stopWriting))
       {
-        p->numProcessedBlocks = blockIndex;
         MtSync_StopWriting(&mt->hashSync);
         Event_Set(&p->wasStopped);
         break;
       }
-      Semaphore_Wait(&p->freeSemaphore);
+      if (!MtSync_WaitFree(p, blockIndex))
+        continue;
       BtFillBlock(mt, blockIndex++);
-      Semaphore_Release1(&p->filledSemaphore);
+      MtSync_PutBlock(p, blockIndex);
     }
   }
 }
@@ -431,28 +696,83 @@ void BtThreadFunc(CMatchFinderMt *mt)
 void MatchFinderMt_Construct(CMatchFinderMt *p)
 {
   p->hashBuf = 0;
+  p->btJobBuf = 0;
+  p->btJobBufSize = 0;
+  p->numBtThreads = 1;
+  p->numBtWorkers = 0;
+  p->lzPos = 0; /* MatchFinderMt_Init reads the previous value */
   MtSync_Construct(&p->hashSync);
   MtSync_Construct(&p->btSync);
 }
 
+static void BtWorkers_Destruct(CMatchFinderMt *p)
+{
+  UInt32 i;
+  p->btWorkersExit = True;
+  for (i = 0; i < p->numBtWorkers; i++)
+  {
+    CMtBtWorker *w = &p->btWorkers[i];
+    if (Thread_WasCreated(&w->thread))
+    {
+      Event_Set(&w->canStart);
+      Thread_Wait(&w->thread);
+      Thread_Close(&w->thread);
+    }
+    Event_Close(&w->canStart);
+    Event_Close(&w->wasFinished);
+  }
+  p->numBtWorkers = 0;
+}
+
+static SRes BtWorkers_Create(CMatchFinderMt *p, UInt32 numWorkers)
+{
+  UInt32 i;
+  if (p->numBtWorkers == numWorkers)
+    return SZ_OK;
+  BtWorkers_Destruct(p);
+  p->btWorkersExit = False;
+  for (i = 0; i < numWorkers; i++)
+  {
+    CMtBtWorker *w = &p->btWorkers[i];
+    w->mt = p;
+    w->index = i + 1;
+    Thread_Construct(&w->thread);
+    Event_Construct(&w->canStart);
+    Event_Construct(&w->wasFinished);
+    p->numBtWorkers = i + 1;
+    if (AutoResetEvent_CreateNotSignaled(&w->canStart) != 0 ||
+        AutoResetEvent_CreateNotSignaled(&w->wasFinished) != 0 ||
+        Thread_Create(&w->thread, BtWorkerThreadFunc, w) != 0)
+    {
+      BtWorkers_Destruct(p);
+      return SZ_ERROR_THREAD;
+    }
+  }
+  return SZ_OK;
+}
+
 void MatchFinderMt_FreeMem(CMatchFinderMt *p, ISzAlloc *alloc)
 {
   alloc->Free(alloc, p->hashBuf);
   p->hashBuf = 0;
+  alloc->Free(alloc, p->btJobBuf);
+  p->btJobBuf = 0;
+  p->btJobBufSize = 0;
 }
 
 void MatchFinderMt_Destruct(CMatchFinderMt *p, ISzAlloc *alloc)
 {
   MtSync_Destruct(&p->hashSync);
   MtSync_Destruct(&p->btSync);
+  BtWorkers_Destruct(p);
   MatchFinderMt_FreeMem(p, alloc);
 }
 
 #define kHashBufferSize (kMtHashBlockSize * kMtHashNumBlocks)
 #define kBtBufferSize (kMtBtBlockSize * kMtBtNumBlocks)
 
-static unsigned MY_STD_CALL HashThreadFunc2(void *p) { HashThreadFunc((CMatchFinderMt *)p);  return 0; }
-static unsigned MY_STD_CALL BtThreadFunc2(void *p)
+static THREAD_FUNC_DECL HashThreadFunc2(void *p) { HashThreadFunc((CMatchFinderMt *)p);  return 0; }
+static THREAD_FUNC_DECL BtThreadFunc2(void *p)
 {
   Byte allocaDummy[0x180];
   int i = 0;
@@ -462,6 +782,29 @@ static unsigned MY_STD_CALL BtThreadFunc2(void *p)
   return 0;
 }
 
+/* returns the job size of the bt workers, 0 if there are no workers */
+
+static UInt32 MatchFinderMt_GetJobSize(UInt32 historySize, UInt32 numBtThreads)
+{
+  UInt32 jobSize = (historySize + 1) >> 4;
+  if (jobSize > kMtBtJobSize)
+    jobSize = kMtBtJobSize;
+  if (numBtThreads > 1 && jobSize >= kMtBtJobSizeMin)
+    return jobSize;
+  return 0;
+}
+
+UInt64 MatchFinderMt_EstimateMemory(UInt32 historySize, UInt32 keepAddBufferBefore,
+    UInt32 matchMaxLen, UInt32 keepAddBufferAfter, UInt32 numHashBytes, UInt32 numBtThreads,
+    int directInput)
+{
+  UInt64 size = (kHashBufferSize + kBtBufferSize) * sizeof(UInt32);
+  size += MatchFinder_EstimateMemory(historySize, keepAddBufferBefore + kHashBufferSize + kBtBufferSize,
+      matchMaxLen, keepAddBufferAfter + kMtHashBlockSize, numHashBytes, 1, directInput);
+  size += (UInt64)MatchFinderMt_GetJobSize(historySize, numBtThreads) * (matchMaxLen * 2 + 1) * sizeof(UInt32);
+  return size;
+}
+
 SRes MatchFinderMt_Create(CMatchFinderMt *p, UInt32 historySize, UInt32 keepAddBufferBefore,
     UInt32 matchMaxLen, UInt32 keepAddBufferAfter, ISzAlloc *alloc)
 {
@@ -483,22 +826,58 @@ SRes MatchFinderMt_Create(CMatchFinderMt *p, UInt32 historySize, UInt32 keepAddB
 
   RINOK(MtSync_Create(&p->hashSync, HashThreadFunc2, p, kMtHashNumBlocks));
   RINOK(MtSync_Create(&p->btSync, BtThreadFunc2, p, kMtBtNumBlocks));
-  return SZ_OK;
+
+  {
+    UInt32 numWorkers = 0;
+    UInt32 jobSize = MatchFinderMt_GetJobSize(historySize, p->numBtThreads);
+    if (jobSize != 0)
+    {
+      size_t bufSize;
+      numWorkers = p->numBtThreads - 1;
+      if (numWorkers > kMtBtNumThreadsMax - 1)
+        numWorkers = kMtBtNumThreadsMax - 1;
+      p->btJobSize = jobSize;
+      p->btJobStride = matchMaxLen * 2 + 1;
+      bufSize = (size_t)jobSize * p->btJobStride;
+      if (p->btJobBuf == 0 || p->btJobBufSize != bufSize)
+      {
+        alloc->Free(alloc, p->btJobBuf);
+        p->btJobBufSize = 0;
+        p->btJobBuf = (UInt32 *)alloc->Alloc(alloc, bufSize * sizeof(UInt32));
+        if (p->btJobBuf == 0)
+          return SZ_ERROR_MEM;
+        p->btJobBufSize = bufSize;
+      }
+    }
+    return BtWorkers_Create(p, numWorkers);
+  }
 }
 
 /* Call it after ReleaseStream / SetStream */
 void MatchFinderMt_Init(CMatchFinderMt *p)
 {
   CMatchFinder *mf = p->MatchFinder;
+  UInt32 prevLzPos = p->lzPos;
   p->btBufPos = p->btBufPosLimit = 0;
   p->hashBufPos = p->hashBufPosLimit = 0;
   MatchFinder_Init(mf);
   p->pointerToCurPos = MatchFinder_GetPointerToCurrentPos(mf);
   p->btNumAvailBytes = 0;
-  p->lzPos = p->historySize + 1;
 
   p->hash = mf->hash;
   p->fixedHashSize = mf->fixedHashSize;
+
+  /* lzPos (the position for the fixed hash tables) follows the rebased mf->pos.
+     It is (historySize + 1), if MatchFinder_Init has cleared the tables. Usually lzPos
+     lags behind mf->pos, but it can be ahead after mf->pos normalization by the hash thread:
+     then the old references in the fixed tables can be in the new window. */
+  p->lzPos = mf->pos;
+  if (mf->pos != mf->cyclicBufferSize && prevLzPos > mf->pos - mf->cyclicBufferSize)
+  {
+    UInt32 i;
+    for (i = 0; i < p->fixedHashSize; i++)
+      p->hash[i] = 0;
+  }
   p->crc = mf->crc;
 
   p->son = mf->son;
@@ -509,6 +888,7 @@ void MatchFinderMt_Init(CMatchFinderMt *p)
   p->cyclicBufferPos = mf->cyclicBufferPos;
   p->cyclicBufferSize = mf->cyclicBufferSize;
   p->cutValue = mf->cutValue;
+  p->btJobNum = p->btJobPos = 0;
 }
 
 /* ReleaseStream is required to finish multithreading */
@@ -766,18 +1146,21 @@ void MatchFinderMt_CreateVTable(CMatchFinderMt *p, IMatchFinder *vTable)
   {
     case 2:
       p->GetHeadsFunc = GetHeads2;
+      p->GetHashValueFunc = GetHashValue2;
       p->MixMatchesFunc = (Mf_Mix_Matches)0;
       vTable->Skip = (Mf_Skip_Func)MatchFinderMt0_Skip;
       vTable->GetMatches = (Mf_GetMatches_Func)MatchFinderMt2_GetMatches;
       break;
     case 3:
       p->GetHeadsFunc = GetHeads3;
+      p->GetHashValueFunc = GetHashValue3;
       p->MixMatchesFunc = (Mf_Mix_Matches)MixMatches2;
       vTable->Skip = (Mf_Skip_Func)MatchFinderMt2_Skip;
       break;
     default:
     /* case 4: */
       p->GetHeadsFunc = p->MatchFinder->bigHash ? GetHeads4b : GetHeads4;
+      p->GetHashValueFunc = p->MatchFinder->bigHash ? GetHashValue4b : GetHashValue4;
       /* p->GetHeadsFunc = GetHeads4; */
       p->MixMatchesFunc = (Mf_Mix_Matches)MixMatches3;
       vTable->Skip = (Mf_Skip_Func)MatchFinderMt3_Skip;
@@ -19,6 +19,28 @@ extern "C" {
 #define kMtBtNumBlocks (1 << 6)
 #define kMtBtNumBlocksMask (kMtBtNumBlocks - 1)
 
+/* The binary tree work can be split across several threads (numBtThreads > 1).
+   Each BT thread updates only the trees of the hash values that belong to it
+   (hashValue % numBtThreads), so the trees are never shared. The positions
+   are processed by jobs of up to kMtBtJobSize positions. */
+
+#define kMtBtJobSize (1 << 12)
+#define kMtBtJobSizeMin (1 << 8)
+#define kMtBtNumThreadsMax 15
+
+/* CMtSync is a single-producer / single-consumer ring of numBlocks blocks.
+   The producer thread increments numFilledBlocks after it writes a block,
+   the consumer increments numFreedBlocks after it has read a block.
+   The waiting side spins for a while and then it sleeps on the event of
+   its CMtWaiter, until the other side wakes it. */
+
+typedef struct _CMtWaiter
+{
+  volatile UInt32 waiting;
+  CAutoResetEvent event;
+  UInt32 spinCount;
+} CMtWaiter;
+
 typedef struct _CMtSync
 {
   Bool wasCreated;
@@ -30,8 +52,11 @@ typedef struct _CMtSync
   CAutoResetEvent canStart;
   CAutoResetEvent wasStarted;
   CAutoResetEvent wasStopped;
-  CSemaphore freeSemaphore;
-  CSemaphore filledSemaphore;
+  UInt32 numBlocks;
+  volatile UInt32 numFilledBlocks;
+  volatile UInt32 numFreedBlocks;
+  CMtWaiter producer;
+  CMtWaiter consumer;
   Bool csWasInitialized;
   Bool csWasEntered;
   CCriticalSection cs;
@@ -40,11 +65,23 @@ typedef struct _CMtSync
 
 typedef UInt32 * (*Mf_Mix_Matches)(void *p, UInt32 matchMinPos, UInt32 *distances);
 
+struct _CMatchFinderMt;
+
+typedef struct _CMtBtWorker
+{
+  CThread thread;
+  CAutoResetEvent canStart;
+  CAutoResetEvent wasFinished;
+  struct _CMatchFinderMt *mt;
+  UInt32 index;
+} CMtBtWorker;
+
 /* kMtCacheLineDummy must be >= size_of_CPU_cache_line */
 #define kMtCacheLineDummy 128
 
 typedef void (*Mf_GetHeads)(const Byte *buffer, UInt32 pos,
   UInt32 *hash, UInt32 hashMask, UInt32 *heads, UInt32 numHeads, const UInt32 *crc);
+typedef UInt32 (*Mf_GetHashValue)(const Byte *p, UInt32 hashMask, const UInt32 *crc);
 
 typedef struct _CMatchFinderMt
 {
@@ -82,6 +119,24 @@ typedef struct _CMatchFinderMt
   UInt32 cyclicBufferSize; /* it must be historySize + 1 */
   UInt32 cutValue;
 
+  /* BT workers */
+  UInt32 numBtThreads;  /* requested number of BT threads, 1 <= numBtThreads <= kMtBtNumThreadsMax */
+  UInt32 numBtWorkers;  /* additional threads that were created. 0 - single BT thread */
+  Bool btWorkersExit;
+  UInt32 btJobSize;
+  UInt32 btJobStride;
+  UInt32 *btJobBuf;
+  size_t btJobBufSize;
+  UInt32 btJobNum;      /* number of positions in the current job */
+  UInt32 btJobPos;      /* next position of the current job that must be written to btBuf */
+  UInt32 btJobStartPos;
+  UInt32 btJobCyclicBufferPos;
+  UInt32 btJobLenLimit;
+  const Byte *btJobBuffer;
+  const UInt32 *btJobHeads;
+  Mf_GetHashValue GetHashValueFunc;
+  CMtBtWorker btWorkers[kMtBtNumThreadsMax - 1];
+
   /* BT + Hash */
   CMtSync hashSync;
   /* Byte hashDummy[kMtCacheLineDummy]; */
@@ -95,6 +150,10 @@ void MatchFinderMt_Construct(CMatchFinderMt *p);
 void MatchFinderMt_Destruct(CMatchFinderMt *p, ISzAlloc *alloc);
 SRes MatchFinderMt_Create(CMatchFinderMt *p, UInt32 historySize, UInt32 keepAddBufferBefore,
     UInt32 matchMaxLen, UInt32 keepAddBufferAfter, ISzAlloc *alloc);
+/* the size of the blocks that MatchFinderMt_Create allocates (see MatchFinder_EstimateMemory) */
+UInt64 MatchFinderMt_EstimateMemory(UInt32 historySize, UInt32 keepAddBufferBefore,
+    UInt32 matchMaxLen, UInt32 keepAddBufferAfter, UInt32 numHashBytes, UInt32 numBtThreads,
+    int directInput);
 void MatchFinderMt_CreateVTable(CMatchFinderMt *p, IMatchFinder *vTable);
 void MatchFinderMt_ReleaseStream(CMatchFinderMt *p);
 
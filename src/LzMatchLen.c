@@ -0,0 +1,153 @@
+/* LzMatchLen.c -- Match length functions for match finders
+2026-10-17 : Public domain */
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#include "LzMatchLen.h"
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) && _MSC_VER >= 1800 || defined(__i386__) && defined(__SSE2__)
+#define LZ_MATCH_LEN_SSE2
+#if defined(_MSC_VER) && _MSC_VER >= 1800 || defined(__GNUC__) && (__GNUC__ >= 5 || defined(__clang__))
+#define LZ_MATCH_LEN_AVX2
+#endif
+#endif
+
+#ifdef LZ_MATCH_LEN_SSE2
+#include <emmintrin.h>
+#endif
+#ifdef LZ_MATCH_LEN_AVX2
+#include <immintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#pragma intrinsic(_BitScanForward)
+static __forceinline unsigned Ctz32(UInt32 v) { unsigned long i; _BitScanForward(&i, v); return (unsigned)i; }
+#else
+#define Ctz32(v) ((unsigned)__builtin_ctz(v))
+#endif
+
+static UInt32 MY_FAST_CALL LzMatchLen_Tail(const Byte *p1, const Byte *p2, UInt32 len, UInt32 lenLimit)
+{
+  #ifdef LZ_MATCH_LEN_WORD
+  for (; lenLimit - len >= 8; len += 8)
+  {
+    UInt64 d = LzMatchLen_GetUi64(p1 + len) ^ LzMatchLen_GetUi64(p2 + len);
+    if (d != 0)
+      return len + (LzMatchLen_Ctz64(d) >> 3);
+  }
+  #endif
+  for (; len != lenLimit; len++)
+    if (p1[len] != p2[len])
+      break;
+  return len;
+}
+
+#ifdef LZ_MATCH_LEN_SSE2
+
+static UInt32 MY_FAST_CALL LzMatchLen_Sse2(const Byte *p1, const Byte *p2, UInt32 len, UInt32 lenLimit)
+{
+  for (; lenLimit - len >= 16; len += 16)
+  {
+    unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(
+        _mm_loadu_si128((const __m128i *)(p1 + len)),
+        _mm_loadu_si128((const __m128i *)(p2 + len))));
+    if (mask != 0xFFFF)
+      return len + Ctz32(~mask);
+  }
+  return LzMatchLen_Tail(p1, p2, len, lenLimit);
+}
+
+#endif
+
+#ifdef LZ_MATCH_LEN_AVX2
+
+#ifdef __GNUC__
+__attribute__((target("avx2")))
+#endif
+static UInt32 MY_FAST_CALL LzMatchLen_Avx2(const Byte *p1, const Byte *p2, UInt32 len, UInt32 lenLimit)
+{
+  for (; lenLimit - len >= 32; len += 32)
+  {
+    UInt32 mask = (UInt32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(
+        _mm256_loadu_si256((const __m256i *)(p1 + len)),
+        _mm256_loadu_si256((const __m256i *)(p2 + len))));
+    if (mask != 0xFFFFFFFF)
+      return len + Ctz32(~mask);
+  }
+  return LzMatchLen_Sse2(p1, p2, len, lenLimit);
+}
+
+static Bool LzMatchLen_HaveAvx2(void)
+{
+  #ifdef _MSC_VER
+  int regs[4];
+  __cpuid(regs, 0);
+  if (regs[0] < 7)
+    return False;
+  __cpuid(regs, 1);
+  /* OSXSAVE and AVX */
+  if ((regs[2] & (1 << 27)) == 0 || (regs[2] & (1 << 28)) == 0)
+    return False;
+  /* the OS saves XMM and YMM registers */
+  if ((_xgetbv(0) & 6) != 6)
+    return False;
+  __cpuidex(regs, 7, 0);
+  return (regs[1] & (1 << 5)) != 0;
+  #else
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2") != 0;
+  #endif
+}
+
+#endif
+
+Lz_MatchLenFunc g_LzMatchLenLong = LzMatchLen_Tail;
+
+static void LzMatchLen_Select(void)
+{
+  Lz_MatchLenFunc f = LzMatchLen_Tail;
+  #ifdef LZ_MATCH_LEN_SSE2
+  f = LzMatchLen_Sse2;
+  #endif
+  #ifdef LZ_MATCH_LEN_AVX2
+  if (LzMatchLen_HaveAvx2())
+    f = LzMatchLen_Avx2;
+  #endif
+  g_LzMatchLenLong = f;
+}
+
+/* The encoders of different threads construct their match finders at the same time,
+   so g_LzMatchLenLong is written only once. InitOnceExecuteOnce needs Vista,
+   and the library is also built for XP. */
+
+#ifdef _WIN32
+
+static volatile LONG g_LzMatchLenState = 0;  /* 0 - not selected, 1 - selecting, 2 - selected */
+
+void LzMatchLen_Init(void)
+{
+  if (InterlockedCompareExchange(&g_LzMatchLenState, 1, 0) == 0)
+  {
+    LzMatchLen_Select();
+    InterlockedExchange(&g_LzMatchLenState, 2);
+    return;
+  }
+  while (InterlockedCompareExchange(&g_LzMatchLenState, 2, 2) != 2)
+    Sleep(0);
+}
+
+#else
+
+static pthread_once_t g_LzMatchLenOnce = PTHREAD_ONCE_INIT;
+
+void LzMatchLen_Init(void)
+{
+  pthread_once(&g_LzMatchLenOnce, LzMatchLen_Select);
+}
+
+#endif
@@ -0,0 +1,80 @@
+/* LzMatchLen.h -- Match length functions for match finders
+2026-10-17 : Public domain */
+
+#ifndef __LZ_MATCH_LEN_H
+#define __LZ_MATCH_LEN_H
+
+#include <string.h>
+
+#include "Types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+LzMatchLen(p1, p2, len, lenLimit) returns the first position (pos) in [len, lenLimit),
+where p1[pos] != p2[pos], or it returns (lenLimit), if there is no such position.
+  (len <= lenLimit) is required.
+  Bytes at and after (lenLimit) are never read.
+
+The first 8 bytes are compared inline with 64-bit XOR and count of trailing zeros.
+Longer matches go to g_LzMatchLenLong that is selected at runtime by
+LzMatchLen_Init(): AVX2, SSE2 or 64-bit word loop.
+*/
+
+typedef UInt32 (MY_FAST_CALL *Lz_MatchLenFunc)(const Byte *p1, const Byte *p2, UInt32 len, UInt32 lenLimit);
+
+extern Lz_MatchLenFunc g_LzMatchLenLong;
+
+/* LzMatchLen_Init can be called many times and from many threads: the function
+   is selected only in the first call. MatchFinder_Construct() calls it. */
+void LzMatchLen_Init(void);
+
+#if defined(_M_X64) || defined(_M_ARM64) || \
+    defined(__GNUC__) && defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define LZ_MATCH_LEN_WORD
+#endif
+
+#ifdef LZ_MATCH_LEN_WORD
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#if defined(_M_X64) || defined(_M_ARM64)
+#pragma intrinsic(_BitScanForward64)
+static __forceinline unsigned LzMatchLen_Ctz64(UInt64 v) { unsigned long i; _BitScanForward64(&i, v); return (unsigned)i; }
+#endif
+#define LZ_MATCH_LEN_INLINE __forceinline
+#else
+#define LzMatchLen_Ctz64(v) ((unsigned)__builtin_ctzll(v))
+#define LZ_MATCH_LEN_INLINE __inline
+#endif
+
+static LZ_MATCH_LEN_INLINE UInt64 LzMatchLen_GetUi64(const Byte *p) { UInt64 v; memcpy(&v, p, 8); return v; }
+
+static LZ_MATCH_LEN_INLINE UInt32 LzMatchLen(const Byte *p1, const Byte *p2, UInt32 len, UInt32 lenLimit)
+{
+  if (lenLimit - len >= 8)
+  {
+    UInt64 d = LzMatchLen_GetUi64(p1 + len) ^ LzMatchLen_GetUi64(p2 + len);
+    if (d != 0)
+      return len + (LzMatchLen_Ctz64(d) >> 3);
+    return g_LzMatchLenLong(p1, p2, len + 8, lenLimit);
+  }
+  for (; len != lenLimit; len++)
+    if (p1[len] != p2[len])
+      break;
+  return len;
+}
+
+#else
+
+#define LzMatchLen(p1, p2, len, lenLimit) g_LzMatchLenLong(p1, p2, len, lenLimit)
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
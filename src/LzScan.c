@@ -0,0 +1,72 @@
+/* LzScan.c -- Incompressible data detection
+2026-10-17 : Public domain */
+
+#include <string.h>
+
+#include "LzScan.h"
+
+#define kScanWindowSize (1 << 12)
+#define kScanNumWindowsMax 8
+#define kScanHashBits 12
+
+/* The window is compressible if sum(p[i]^2) > 1 / kScanCollisionMin,
+   i.e. the collision entropy is lower than log2(208) = 7.7 bits per byte. */
+#define kScanCollisionMin 208
+
+/* The window is compressible if more than 1 / kScanMatchRateMax of positions
+   start a 4-byte sequence that was seen before in the window. */
+#define kScanMatchRateMax 32
+
+#define GetUi32(p) ((UInt32)(p)[0] | ((UInt32)(p)[1] << 8) | ((UInt32)(p)[2] << 16) | ((UInt32)(p)[3] << 24))
+
+static Bool LzScan_IsWindowIncompressible(const Byte *p, UInt32 size, UInt16 *hash)
+{
+  UInt32 counters[256];
+  UInt64 sum = 0;
+  UInt32 i, numMatches = 0;
+
+  memset(counters, 0, sizeof(counters));
+  for (i = 0; i < size; i++)
+    counters[p[i]]++;
+  for (i = 0; i < 256; i++)
+    sum += (UInt64)counters[i] * counters[i];
+  /* (sum - n) / (n * (n - 1)) is the unbiased estimate of sum(p[i]^2) */
+  if ((sum - size) * kScanCollisionMin > (UInt64)size * (size - 1))
+    return False;
+
+  memset(hash, 0, sizeof(UInt16) << kScanHashBits);
+  for (i = 0; i + 4 <= size; i++)
+  {
+    UInt32 v = GetUi32(p + i);
+    UInt32 h = (v * 0x9E3779B1) >> (32 - kScanHashBits);
+    UInt32 prev = hash[h];
+    hash[h] = (UInt16)(i + 1);
+    if (prev != 0 && GetUi32(p + prev - 1) == v)
+      numMatches++;
+  }
+  return (numMatches * kScanMatchRateMax < size);
+}
+
+Bool LzScan_IsIncompressible(const Byte *data, SizeT size)
+{
+  UInt16 hash[1 << kScanHashBits];
+  UInt32 numWindows, numCompressible = 0, i;
+  if (size < kScanWindowSize)
+    return False;
+  numWindows = kScanNumWindowsMax;
+  if (size / kScanWindowSize < numWindows)
+    numWindows = (UInt32)(size / kScanWindowSize);
+  for (i = 0; i < numWindows; i++)
+  {
+    SizeT pos = 0;
+    if (numWindows > 1)
+      pos = (SizeT)((UInt64)(size - kScanWindowSize) * i / (numWindows - 1));
+    if (!LzScan_IsWindowIncompressible(data + pos, kScanWindowSize, hash))
+    {
+      /* one window of 8 can be a header or metadata inside the media file */
+      if (++numCompressible * kScanNumWindowsMax > numWindows)
+        return False;
+    }
+  }
+  return True;
+}
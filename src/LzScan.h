@@ -0,0 +1,28 @@
+/* LzScan.h -- Incompressible data detection
+2026-10-17 : Public domain */
+
+#ifndef __LZ_SCAN_H
+#define __LZ_SCAN_H
+
+#include "Types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+LzScan_IsIncompressible samples up to 8 windows of 4 KB (the first window is
+the start of data) and returns True only if the windows have nearly flat
+byte distribution (about 7.7 bits per byte or more) and almost no repeated
+4-byte sequences. One window of 8 is allowed to fail the test. That is typical for the data that is already compressed
+or encrypted (JPEG, MP4, zip). The cost doesn't depend on size.
+Data smaller than 4 KB is never reported as incompressible.
+*/
+
+Bool LzScan_IsIncompressible(const Byte *data, SizeT size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,437 @@
+/* Lzma2Enc.c -- LZMA2 Encoder
+2026-10-17 : Public domain */
+
+/* #include <stdio.h> */
+#include <string.h>
+
+#include "Lzma2Enc.h"
+#include "LzScan.h"
+
+/* #define PRF(x) x */
+#define PRF(x)
+
+#define LZMA2_CONTROL_LZMA (1 << 7)
+#define LZMA2_CONTROL_COPY_NO_RESET 2
+#define LZMA2_CONTROL_COPY_RESET_DIC 1
+#define LZMA2_CONTROL_EOF 0
+
+#define LZMA2_LCLP_MAX 4
+
+#define LZMA2_DIC_SIZE_FROM_PROP(p) (((UInt32)2 | ((p) & 1)) << ((p) / 2 + 11))
+
+#define LZMA2_PACK_SIZE_MAX (1 << 16)
+#define LZMA2_COPY_CHUNK_SIZE LZMA2_PACK_SIZE_MAX
+#define LZMA2_UNPACK_SIZE_MAX (1 << 21)
+#define LZMA2_KEEP_WINDOW_SIZE LZMA2_UNPACK_SIZE_MAX
+
+#define LZMA2_CHUNK_SIZE_COMPRESSED_MAX ((1 << 16) + 16)
+
+#define LZMA2_BLOCK_SIZE_MIN (1 << 20)
+
+/* LzmaEnc.c hooks that are not in LzmaEnc.h */
+
+SRes LzmaEnc_PrepareForLzma2(CLzmaEncHandle pp, ISeqInStream *inStream, UInt32 keepWindowSize,
+    ISzAlloc *alloc, ISzAlloc *allocBig);
+SRes LzmaEnc_MemPrepare(CLzmaEncHandle pp, const Byte *src, SizeT srcLen,
+    UInt32 keepWindowSize, ISzAlloc *alloc, ISzAlloc *allocBig);
+SRes LzmaEnc_CodeOneMemBlock(CLzmaEncHandle pp, Bool reInit,
+    Byte *dest, size_t *destLen, UInt32 desiredPackSize, UInt32 *unpackSize);
+const Byte *LzmaEnc_GetCurBuf(CLzmaEncHandle pp);
+void LzmaEnc_SkipMemBlock(CLzmaEncHandle pp, UInt32 size);
+void LzmaEnc_Finish(CLzmaEncHandle pp);
+void LzmaEnc_SaveState(CLzmaEncHandle pp);
+void LzmaEnc_RestoreState(CLzmaEncHandle pp);
+
+/* ---------- CLzma2EncInt ---------- */
+
+typedef struct
+{
+  CLzmaEncHandle enc;
+  UInt64 srcPos;
+  Byte props;
+  Bool needInitState;
+  Bool needInitProp;
+} CLzma2EncInt;
+
+static SRes Lzma2EncInt_Init(CLzma2EncInt *p, const CLzma2EncProps *props)
+{
+  Byte propsEncoded[LZMA_PROPS_SIZE];
+  SizeT propsSize = LZMA_PROPS_SIZE;
+  RINOK(LzmaEnc_SetProps(p->enc, &props->lzmaProps));
+  RINOK(LzmaEnc_WriteProperties(p->enc, propsEncoded, &propsSize));
+  p->srcPos = 0;
+  p->props = propsEncoded[0];
+  p->needInitState = True;
+  p->needInitProp = True;
+  return SZ_OK;
+}
+
+/*
+Lzma2EncInt_EncodeSubblock encodes the next chunk from the match finder window.
+The chunk is coded by LZMA first. If LZMA doesn't save at least 3 bytes
+(or the packed size doesn't fit into the chunk), the encoder state is restored
+and the same bytes are written as uncompressed (copy) chunks.
+If (outStream) is NULL, the chunk is written to outBuf and (*packSizeRes)
+is its size. Else outBuf is a temporary buffer of
+LZMA2_CHUNK_SIZE_COMPRESSED_MAX bytes and the chunk is written to outStream.
+(*packSizeRes == 0) means that there is no more data.
+*/
+
+static SRes Lzma2EncInt_EncodeSubblock(CLzma2EncInt *p, Byte *outBuf,
+    size_t *packSizeRes, ISeqOutStream *outStream)
+{
+  size_t packSizeLimit = *packSizeRes;
+  size_t packSize = packSizeLimit;
+  UInt32 unpackSize = LZMA2_UNPACK_SIZE_MAX;
+  unsigned lzHeaderSize = 5 + (p->needInitProp ? 1 : 0);
+  Bool useCopyBlock;
+  SRes res;
+
+  *packSizeRes = 0;
+  if (packSize < lzHeaderSize)
+    return SZ_ERROR_OUTPUT_EOF;
+  packSize -= lzHeaderSize;
+  
+  LzmaEnc_SaveState(p->enc);
+  res = LzmaEnc_CodeOneMemBlock(p->enc, p->needInitState,
+      outBuf + lzHeaderSize, &packSize, LZMA2_PACK_SIZE_MAX, &unpackSize);
+  
+  PRF(printf("\npackSize = %7d unpackSize = %7d  ", packSize, unpackSize));
+
+  if (unpackSize == 0)
+    return res;
+
+  if (res == SZ_OK)
+    useCopyBlock = (packSize + 2 >= unpackSize || packSize > (1 << 16));
+  else
+  {
+    if (res != SZ_ERROR_OUTPUT_EOF)
+      return res;
+    res = SZ_OK;
+    useCopyBlock = True;
+  }
+
+  if (useCopyBlock)
+  {
+    size_t destPos = 0;
+    PRF(printf("################# COPY           "));
+    while (unpackSize > 0)
+    {
+      UInt32 u = (unpackSize < LZMA2_COPY_CHUNK_SIZE) ? unpackSize : LZMA2_COPY_CHUNK_SIZE;
+      if (packSizeLimit - destPos < u + 3)
+        return SZ_ERROR_OUTPUT_EOF;
+      outBuf[destPos++] = (Byte)(p->srcPos == 0 ? LZMA2_CONTROL_COPY_RESET_DIC : LZMA2_CONTROL_COPY_NO_RESET);
+      outBuf[destPos++] = (Byte)((u - 1) >> 8);
+      outBuf[destPos++] = (Byte)(u - 1);
+      memcpy(outBuf + destPos, LzmaEnc_GetCurBuf(p->enc) - unpackSize, u);
+      unpackSize -= u;
+      destPos += u;
+      p->srcPos += u;
+      if (outStream)
+      {
+        *packSizeRes += destPos;
+        if (outStream->Write(outStream, outBuf, destPos) != destPos)
+          return SZ_ERROR_WRITE;
+        destPos = 0;
+      }
+      else
+        *packSizeRes = destPos;
+    }
+    /* the decoder doesn't change the state for copy chunks */
+    LzmaEnc_RestoreState(p->enc);
+    return SZ_OK;
+  }
+  {
+    size_t destPos = 0;
+    UInt32 u = unpackSize - 1;
+    UInt32 pm = (UInt32)(packSize - 1);
+    unsigned mode = (p->srcPos == 0) ? 3 : (p->needInitState ? (p->needInitProp ? 2 : 1) : 0);
+
+    outBuf[destPos++] = (Byte)(LZMA2_CONTROL_LZMA | (mode << 5) | ((u >> 16) & 0x1F));
+    outBuf[destPos++] = (Byte)(u >> 8);
+    outBuf[destPos++] = (Byte)u;
+    outBuf[destPos++] = (Byte)(pm >> 8);
+    outBuf[destPos++] = (Byte)pm;
+    
+    if (p->needInitProp)
+      outBuf[destPos++] = p->props;
+    
+    p->needInitProp = False;
+    p->needInitState = False;
+    destPos += packSize;
+    p->srcPos += unpackSize;
+
+    if (outStream)
+      if (outStream->Write(outStream, outBuf, destPos) != destPos)
+        return SZ_ERROR_WRITE;
+    *packSizeRes = destPos;
+    return SZ_OK;
+  }
+}
+
+/* Lzma2_WriteCopyChunks writes (srcLen) bytes as copy chunks,
+   the first chunk resets the dictionary, if (resetDic) */
+
+static SRes Lzma2_WriteCopyChunks(Byte *dest, size_t *destLen, const Byte *src, SizeT srcLen, Bool resetDic)
+{
+  size_t outSize = *destLen;
+  size_t destPos = 0;
+  SizeT srcPos = 0;
+  *destLen = 0;
+  while (srcPos < srcLen)
+  {
+    UInt32 u = LZMA2_COPY_CHUNK_SIZE;
+    if (srcLen - srcPos < u)
+      u = (UInt32)(srcLen - srcPos);
+    if (outSize - destPos < u + 3)
+      return SZ_ERROR_OUTPUT_EOF;
+    dest[destPos++] = (Byte)(resetDic && srcPos == 0 ? LZMA2_CONTROL_COPY_RESET_DIC : LZMA2_CONTROL_COPY_NO_RESET);
+    dest[destPos++] = (Byte)((u - 1) >> 8);
+    dest[destPos++] = (Byte)(u - 1);
+    memcpy(dest + destPos, src + srcPos, u);
+    destPos += u;
+    srcPos += u;
+    *destLen = destPos;
+  }
+  return SZ_OK;
+}
+
+/* ---------- Lzma2 Props ---------- */
+
+void Lzma2EncProps_Init(CLzma2EncProps *p)
+{
+  LzmaEncProps_Init(&p->lzmaProps);
+  p->blockSize = 0;
+  p->storeIncompressible = 1;
+}
+
+void Lzma2EncProps_Normalize(CLzma2EncProps *p)
+{
+  if (p->blockSize != 0 && p->blockSize < LZMA2_BLOCK_SIZE_MIN)
+    p->blockSize = LZMA2_BLOCK_SIZE_MIN;
+  /* each block starts with the empty dictionary, so the dictionary is not larger than the block */
+  if (p->blockSize != 0 && p->lzmaProps.reduceSize > p->blockSize)
+    p->lzmaProps.reduceSize = p->blockSize;
+  LzmaEncProps_Normalize(&p->lzmaProps);
+}
+
+/* ---------- Lzma2 ---------- */
+
+typedef struct
+{
+  CLzma2EncInt coder;
+  CLzma2EncProps props;
+  Byte *outBuf;
+  ISzAlloc *alloc;
+  ISzAlloc *allocBig;
+} CLzma2Enc;
+
+CLzma2EncHandle Lzma2Enc_Create(ISzAlloc *alloc, ISzAlloc *allocBig)
+{
+  CLzma2Enc *p = (CLzma2Enc *)alloc->Alloc(alloc, sizeof(CLzma2Enc));
+  if (p == 0)
+    return NULL;
+  Lzma2EncProps_Init(&p->props);
+  Lzma2EncProps_Normalize(&p->props);
+  p->outBuf = 0;
+  p->alloc = alloc;
+  p->allocBig = allocBig;
+  p->coder.enc = LzmaEnc_Create(alloc);
+  if (p->coder.enc == 0)
+  {
+    alloc->Free(alloc, p);
+    return NULL;
+  }
+  return p;
+}
+
+void Lzma2Enc_Destroy(CLzma2EncHandle pp)
+{
+  CLzma2Enc *p = (CLzma2Enc *)pp;
+  LzmaEnc_Destroy(p->coder.enc, p->alloc, p->allocBig);
+  IAlloc_Free(p->alloc, p->outBuf);
+  IAlloc_Free(p->alloc, pp);
+}
+
+SRes Lzma2Enc_SetProps(CLzma2EncHandle pp, const CLzma2EncProps *props)
+{
+  CLzma2Enc *p = (CLzma2Enc *)pp;
+  CLzmaEncProps lzmaProps = props->lzmaProps;
+  LzmaEncProps_Normalize(&lzmaProps);
+  if (lzmaProps.lc + lzmaProps.lp > LZMA2_LCLP_MAX)
+    return SZ_ERROR_PARAM;
+  p->props = *props;
+  Lzma2EncProps_Normalize(&p->props);
+  return SZ_OK;
+}
+
+Byte Lzma2Enc_WriteProperties(CLzma2EncHandle pp)
+{
+  CLzma2Enc *p = (CLzma2Enc *)pp;
+  unsigned i;
+  UInt32 dicSize = LzmaEncProps_GetDictSize(&p->props.lzmaProps);
+  for (i = 0; i < 40; i++)
+    if (dicSize <= LZMA2_DIC_SIZE_FROM_PROP(i))
+      break;
+  return (Byte)i;
+}
+
+static SRes Progress(ICompressProgress *p, UInt64 inSize, UInt64 outSize)
+{
+  return (p && p->Progress(p, inSize, outSize) != SZ_OK) ? SZ_ERROR_PROGRESS : SZ_OK;
+}
+
+/* CLimitedSeqInStream gives at most (rem) bytes of the real stream to the
+   match finder, so each block of the stream ends where the next one starts. */
+
+typedef struct
+{
+  ISeqInStream funcTable;
+  ISeqInStream *realStream;
+  UInt64 rem;
+  Bool finished;
+} CLimitedSeqInStream;
+
+static SRes LimitedSeqInStream_Read(void *pp, void *data, size_t *size)
+{
+  CLimitedSeqInStream *p = (CLimitedSeqInStream *)pp;
+  size_t size2 = *size;
+  SRes res = SZ_OK;
+  if (p->rem < size2)
+    size2 = (size_t)p->rem;
+  if (size2 != 0)
+  {
+    res = p->realStream->Read(p->realStream, data, &size2);
+    p->finished = (size2 == 0);
+    p->rem -= size2;
+  }
+  *size = size2;
+  return res;
+}
+
+SRes Lzma2Enc_Encode(CLzma2EncHandle pp,
+    ISeqOutStream *outStream, ISeqInStream *inStream, ICompressProgress *progress)
+{
+  CLzma2Enc *p = (CLzma2Enc *)pp;
+  CLzma2EncInt *coder = &p->coder;
+  CLimitedSeqInStream limitedStream;
+  UInt64 unpackTotal = 0;
+  UInt64 packTotal = 0;
+  SRes res = SZ_OK;
+
+  if (p->outBuf == 0)
+  {
+    p->outBuf = (Byte *)IAlloc_Alloc(p->alloc, LZMA2_CHUNK_SIZE_COMPRESSED_MAX);
+    if (p->outBuf == 0)
+      return SZ_ERROR_MEM;
+  }
+
+  limitedStream.funcTable.Read = LimitedSeqInStream_Read;
+  limitedStream.realStream = inStream;
+  limitedStream.finished = False;
+
+  while (res == SZ_OK && !limitedStream.finished)
+  {
+    limitedStream.rem = (p->props.blockSize == 0) ? (UInt64)(Int64)-1 : p->props.blockSize;
+    RINOK(Lzma2EncInt_Init(coder, &p->props));
+    RINOK(LzmaEnc_PrepareForLzma2(coder->enc, &limitedStream.funcTable, LZMA2_KEEP_WINDOW_SIZE,
+        p->alloc, p->allocBig));
+    for (;;)
+    {
+      size_t packSize = LZMA2_CHUNK_SIZE_COMPRESSED_MAX;
+      res = Lzma2EncInt_EncodeSubblock(coder, p->outBuf, &packSize, outStream);
+      if (res != SZ_OK)
+        break;
+      packTotal += packSize;
+      res = Progress(progress, unpackTotal + coder->srcPos, packTotal);
+      if (res != SZ_OK)
+        break;
+      if (packSize == 0)
+        break;
+    }
+    LzmaEnc_Finish(coder->enc);
+    unpackTotal += coder->srcPos;
+    if (limitedStream.rem != 0)
+      break;
+  }
+
+  if (res == SZ_OK)
+  {
+    Byte b = LZMA2_CONTROL_EOF;
+    if (outStream->Write(outStream, &b, 1) != 1)
+      return SZ_ERROR_WRITE;
+  }
+  return res;
+}
+
+SRes Lzma2Enc_MemEncode(CLzma2EncHandle pp, Byte *dest, SizeT *destLen, const Byte *src, SizeT srcLen,
+    ICompressProgress *progress)
+{
+  CLzma2Enc *p = (CLzma2Enc *)pp;
+  CLzma2EncInt *coder = &p->coder;
+  SizeT outSize = *destLen;
+  SizeT destPos = 0;
+  SizeT srcPos = 0;
+  SRes res = SZ_OK;
+
+  *destLen = 0;
+  do
+  {
+    SizeT blockSize = srcLen - srcPos;
+    UInt64 scanPos = 0;
+    if (p->props.blockSize != 0 && blockSize > p->props.blockSize)
+      blockSize = p->props.blockSize;
+    RINOK(Lzma2EncInt_Init(coder, &p->props));
+    RINOK(LzmaEnc_MemPrepare(coder->enc, src + srcPos, blockSize, LZMA2_KEEP_WINDOW_SIZE,
+        p->alloc, p->allocBig));
+    for (;;)
+    {
+      size_t packSize = outSize - destPos;
+      /* each span of LZMA2_UNPACK_SIZE_MAX bytes is checked separately:
+         a few samples can't tell the kind of the whole (solid) block */
+      if (p->props.storeIncompressible && coder->srcPos >= scanPos && coder->srcPos < blockSize)
+      {
+        const Byte *data = src + srcPos + (SizeT)coder->srcPos;
+        UInt32 size = LZMA2_UNPACK_SIZE_MAX;
+        if (blockSize - coder->srcPos < size)
+          size = (UInt32)(blockSize - coder->srcPos);
+        scanPos = coder->srcPos + size;
+        if (LzScan_IsIncompressible(data, size))
+        {
+          res = Lzma2_WriteCopyChunks(dest + destPos, &packSize, data, size, coder->srcPos == 0);
+          if (res != SZ_OK)
+            break;
+          destPos += packSize;
+          LzmaEnc_SkipMemBlock(coder->enc, size);
+          coder->srcPos += size;
+          res = Progress(progress, srcPos + coder->srcPos, destPos);
+          if (res != SZ_OK)
+            break;
+          continue;
+        }
+      }
+      res = Lzma2EncInt_EncodeSubblock(coder, dest + destPos, &packSize, NULL);
+      if (res != SZ_OK)
+        break;
+      destPos += packSize;
+      res = Progress(progress, srcPos + coder->srcPos, destPos);
+      if (res != SZ_OK)
+        break;
+      if (packSize == 0)
+        break;
+    }
+    LzmaEnc_Finish(coder->enc);
+    srcPos += blockSize;
+  }
+  while (res == SZ_OK && srcPos < srcLen);
+
+  if (res == SZ_OK)
+  {
+    if (destPos == outSize)
+      res = SZ_ERROR_OUTPUT_EOF;
+    else
+      dest[destPos++] = LZMA2_CONTROL_EOF;
+  }
+  *destLen = destPos;
+  return res;
+}
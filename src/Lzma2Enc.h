@@ -0,0 +1,60 @@
+/* Lzma2Enc.h -- LZMA2 Encoder
+2026-10-17 : Public domain */
+
+#ifndef __LZMA2_ENC_H
+#define __LZMA2_ENC_H
+
+#include "LzmaEnc.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct
+{
+  CLzmaEncProps lzmaProps;
+  size_t blockSize; /* 0 - solid stream (the dictionary is never reset),
+                       else the dictionary and the state are reset every blockSize bytes,
+                       (1 << 20) <= blockSize. default = 0 */
+  int storeIncompressible; /* 1 - Lzma2Enc_MemEncode writes the spans of up to 2 MB that look
+                              incompressible (LzScan_IsIncompressible) as copy chunks
+                              without LZMA encoding, 0 - all data is encoded. default = 1 */
+} CLzma2EncProps;
+
+void Lzma2EncProps_Init(CLzma2EncProps *p);
+void Lzma2EncProps_Normalize(CLzma2EncProps *p);
+
+/* ---------- CLzma2EncHandle Interface ---------- */
+
+/* Lzma2Enc_* functions can return the following exit codes:
+Returns:
+  SZ_OK           - OK
+  SZ_ERROR_MEM    - Memory allocation error
+  SZ_ERROR_PARAM  - Incorrect paramater in props. (lc + lp) must be <= 4 in LZMA2.
+  SZ_ERROR_WRITE  - Write callback error
+  SZ_ERROR_OUTPUT_EOF - output buffer overflow (Lzma2Enc_MemEncode)
+  SZ_ERROR_PROGRESS - some break from progress callback
+  SZ_ERROR_THREAD - errors in multithreading functions (only for Mt version)
+*/
+
+typedef void * CLzma2EncHandle;
+
+CLzma2EncHandle Lzma2Enc_Create(ISzAlloc *alloc, ISzAlloc *allocBig);
+void Lzma2Enc_Destroy(CLzma2EncHandle p);
+SRes Lzma2Enc_SetProps(CLzma2EncHandle p, const CLzma2EncProps *props);
+Byte Lzma2Enc_WriteProperties(CLzma2EncHandle p);
+
+/* Lzma2Enc_Encode encodes all data (storeIncompressible is not used, the input is not
+   scanned), so its output can differ from Lzma2Enc_MemEncode for the same data.
+   Both streams are decoded the same way. */
+
+SRes Lzma2Enc_Encode(CLzma2EncHandle p,
+    ISeqOutStream *outStream, ISeqInStream *inStream, ICompressProgress *progress);
+SRes Lzma2Enc_MemEncode(CLzma2EncHandle p, Byte *dest, SizeT *destLen, const Byte *src, SizeT srcLen,
+    ICompressProgress *progress);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
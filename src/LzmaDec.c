@@ -704,6 +704,23 @@ void LzmaDec_Init(CLzmaDec *p)
   LzmaDec_InitDicAndState(p, True, True);
 }
 
+SRes LzmaDec_SetPresetDict(CLzmaDec *p, const Byte *data, SizeT size)
+{
+  SizeT copySize = size;
+  if (copySize > p->prop.dicSize)
+    copySize = p->prop.dicSize;
+  /* the stream can refer to any byte of that part, so it's not truncated */
+  if (copySize > p->dicBufSize)
+    return SZ_ERROR_PARAM;
+  memcpy(p->dic, data + size - copySize, copySize);
+  p->dicPos = copySize;
+  /* the position is the same as in the encoder: posState and lp bits depend on it */
+  p->processedPos = (UInt32)size;
+  if (size >= p->prop.dicSize)
+    p->checkDicSize = p->prop.dicSize;
+  return SZ_OK;
+}
+
 static void LzmaDec_InitStateReal(CLzmaDec *p)
 {
   UInt32 numProbs = Literal + ((UInt32)LZMA_LIT_SIZE << (p->prop.lc + p->prop.lp));
@@ -716,6 +733,17 @@ static void LzmaDec_InitStateReal(CLzmaDec *p)
   p->needInitState = 0;
 }
 
+void LzmaDec_InitModel(CLzmaDec *p, const UInt16 *probs)
+{
+  UInt32 numProbs = LzmaProps_GetNumProbs(&p->prop);
+  UInt32 i;
+  for (i = 0; i < numProbs; i++)
+    p->probs[i] = probs[i];
+  p->reps[0] = p->reps[1] = p->reps[2] = p->reps[3] = 1;
+  p->state = 0;
+  p->needInitState = 0;
+}
+
 SRes LzmaDec_DecodeToDic(CLzmaDec *p, SizeT dicLimit, const Byte *src, SizeT *srcLen,
     ELzmaFinishMode finishMode, ELzmaStatus *status)
 {
@@ -921,9 +949,16 @@ SRes LzmaProps_Decode(CLzmaProps *p, const Byte *data, unsigned size)
   return SZ_OK;
 }
 
+UInt64 LzmaDec_EstimateMemory(const CLzmaProps *props)
+{
+  return (UInt64)LzmaProps_GetNumProbs(props) * sizeof(CLzmaProb) + props->dicSize;
+}
+
 static SRes LzmaDec_AllocateProbs2(CLzmaDec *p, const CLzmaProps *propNew, ISzAlloc *alloc)
 {
   UInt32 numProbs = LzmaProps_GetNumProbs(propNew);
+  if (p->memLimit != 0 && (UInt64)numProbs * sizeof(CLzmaProb) > p->memLimit)
+    return SZ_ERROR_MEM;
   if (p->probs == 0 || numProbs != p->numProbs)
   {
     LzmaDec_FreeProbs(p, alloc);
@@ -949,6 +984,8 @@ SRes LzmaDec_Allocate(CLzmaDec *p, const Byte *props, unsigned propsSize, ISzAll
   CLzmaProps propNew;
   SizeT dicBufSize;
   RINOK(LzmaProps_Decode(&propNew, props, propsSize));
+  if (p->memLimit != 0 && LzmaDec_EstimateMemory(&propNew) > p->memLimit)
+    return SZ_ERROR_MEM;
   RINOK(LzmaDec_AllocateProbs2(p, &propNew, alloc));
   dicBufSize = propNew.dicSize;
   if (p->dic == 0 || dicBufSize != p->dicBufSize)
@@ -966,11 +1003,10 @@ SRes LzmaDec_Allocate(CLzmaDec *p, const Byte *props, unsigned propsSize, ISzAll
   return SZ_OK;
 }
 
-SRes LzmaDecode(Byte *dest, SizeT *destLen, const Byte *src, SizeT *srcLen,
+SRes LzmaDec_DecodeOneCall(CLzmaDec *p, Byte *dest, SizeT *destLen, const Byte *src, SizeT *srcLen,
     const Byte *propData, unsigned propSize, ELzmaFinishMode finishMode,
     ELzmaStatus *status, ISzAlloc *alloc)
 {
-  CLzmaDec p;
   SRes res;
   SizeT inSize = *srcLen;
   SizeT outSize = *destLen;
@@ -978,22 +1014,34 @@ SRes LzmaDecode(Byte *dest, SizeT *destLen, const Byte *src, SizeT *srcLen,
   if (inSize < RC_INIT_SIZE)
     return SZ_ERROR_INPUT_EOF;
 
-  LzmaDec_Construct(&p);
-  res = LzmaDec_AllocateProbs(&p, propData, propSize, alloc);
+  res = LzmaDec_AllocateProbs(p, propData, propSize, alloc);
   if (res != 0)
     return res;
-  p.dic = dest;
-  p.dicBufSize = outSize;
+  p->dic = dest;
+  p->dicBufSize = outSize;
 
-  LzmaDec_Init(&p);
+  LzmaDec_Init(p);
   
   *srcLen = inSize;
-  res = LzmaDec_DecodeToDic(&p, outSize, src, srcLen, finishMode, status);
+  res = LzmaDec_DecodeToDic(p, outSize, src, srcLen, finishMode, status);
 
   if (res == SZ_OK && *status == LZMA_STATUS_NEEDS_MORE_INPUT)
     res = SZ_ERROR_INPUT_EOF;
 
-  (*destLen) = p.dicPos;
+  (*destLen) = p->dicPos;
+  p->dic = 0;
+  return res;
+}
+
+SRes LzmaDecode(Byte *dest, SizeT *destLen, const Byte *src, SizeT *srcLen,
+    const Byte *propData, unsigned propSize, ELzmaFinishMode finishMode,
+    ELzmaStatus *status, ISzAlloc *alloc)
+{
+  CLzmaDec p;
+  SRes res;
+  LzmaDec_Construct(&p);
+  res = LzmaDec_DecodeOneCall(&p, dest, destLen, src, srcLen, propData, propSize,
+      finishMode, status, alloc);
   LzmaDec_FreeProbs(&p, alloc);
   return res;
 }
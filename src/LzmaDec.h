@@ -66,9 +66,10 @@ typedef struct
   UInt32 numProbs;
   unsigned tempBufSize;
   Byte tempBuf[LZMA_REQUIRED_INPUT_MAX];
+  UInt64 memLimit; /* for LzmaDec_Allocate*, 0 - no limit */
 } CLzmaDec;
 
-#define LzmaDec_Construct(p) { (p)->dic = 0; (p)->probs = 0; }
+#define LzmaDec_Construct(p) { (p)->dic = 0; (p)->probs = 0; (p)->memLimit = 0; }
 
 void LzmaDec_Init(CLzmaDec *p);
 
@@ -97,6 +98,9 @@ typedef enum
      3) Check that output(srcLen) = compressedSize, if you know real compressedSize.
         You must use correct finish mode in that case. */
 
+#ifndef __LZMA_STATUS_DEFINED
+#define __LZMA_STATUS_DEFINED
+
 typedef enum
 {
   LZMA_STATUS_NOT_SPECIFIED,               /* use main error code instead */
@@ -106,6 +110,8 @@ typedef enum
   LZMA_STATUS_MAYBE_FINISHED_WITHOUT_MARK  /* there is probability that stream was finished without end mark */
 } ELzmaStatus;
 
+#endif
+
 /* ELzmaStatus is used only as output value for function call */
 
 
@@ -127,9 +133,16 @@ typedef enum
 
 LzmaDec_Allocate* can return:
   SZ_OK
-  SZ_ERROR_MEM         - Memory allocation error
+  SZ_ERROR_MEM         - Memory allocation error, or the tables are larger than p->memLimit
   SZ_ERROR_UNSUPPORTED - Unsupported properties
+
+LzmaDec_EstimateMemory returns the size of the blocks of LzmaDec_Allocate
+(the probabilities and the dictionary). LzmaDec_AllocateProbs allocates
+only the probabilities. Both functions check it against p->memLimit before
+the allocation, so a stream header with the huge dictionary is refused.
 */
+
+UInt64 LzmaDec_EstimateMemory(const CLzmaProps *props);
    
 SRes LzmaDec_AllocateProbs(CLzmaDec *p, const Byte *props, unsigned propsSize, ISzAlloc *alloc);
 void LzmaDec_FreeProbs(CLzmaDec *p, ISzAlloc *alloc);
@@ -181,6 +194,25 @@ Returns:
 SRes LzmaDec_DecodeToDic(CLzmaDec *p, SizeT dicLimit,
     const Byte *src, SizeT *srcLen, ELzmaFinishMode finishMode, ELzmaStatus *status);
 
+/* LzmaDec_InitDicAndState resets the dictionary (initDic) and the state (initState)
+   without changing dicPos. It's used by the LZMA2 decoder at chunk boundaries. */
+
+void LzmaDec_InitDicAndState(CLzmaDec *p, Bool initDic, Bool initState);
+
+/* LzmaDec_SetPresetDict - call it after LzmaDec_Init, before the first LzmaDec_DecodeToDic.
+   It copies the end of the preset dictionary (data) to p->dic, so the stream written by
+   LzmaEnc_MemEncodeWithDict with the same dictionary can refer to it. It copies
+   min(size, prop.dicSize) bytes, so the decoded data starts at that dicPos.
+   Returns SZ_ERROR_PARAM, if dicBufSize is smaller than that. */
+
+SRes LzmaDec_SetPresetDict(CLzmaDec *p, const Byte *data, SizeT size);
+
+/* LzmaDec_InitModel - call it after LzmaDec_Init, before the first LzmaDec_DecodeToDic.
+   The decoder starts with the probabilities of the model (see LzmaEnc_SetModel)
+   instead of the default ones. The model must have lc and lp of the stream. */
+
+void LzmaDec_InitModel(CLzmaDec *p, const UInt16 *probs);
+
 
 /* ---------- Buffer Interface ---------- */
 
@@ -224,6 +256,16 @@ SRes LzmaDecode(Byte *dest, SizeT *destLen, const Byte *src, SizeT *srcLen,
     const Byte *propData, unsigned propSize, ELzmaFinishMode finishMode,
     ELzmaStatus *status, ISzAlloc *alloc);
 
+/* LzmaDec_DecodeOneCall
+  The same as LzmaDecode, but it uses the decoder (p) that was initialized
+  with LzmaDec_Construct. p->probs are kept after the call and they are
+  reused by next call, if the number of probs is the same.
+  Call LzmaDec_FreeProbs(p, alloc) to free them. */
+
+SRes LzmaDec_DecodeOneCall(CLzmaDec *p, Byte *dest, SizeT *destLen, const Byte *src, SizeT *srcLen,
+    const Byte *propData, unsigned propSize, ELzmaFinishMode finishMode,
+    ELzmaStatus *status, ISzAlloc *alloc);
+
 #ifdef __cplusplus
 }
 #endif
@@ -48,6 +48,8 @@ void LzmaEncProps_Init(CLzmaEncProps *p)
   p->dictSize = p->mc = 0;
   p->lc = p->lp = p->pb = p->algo = p->fb = p->btMode = p->numHashBytes = p->numThreads = -1;
   p->writeEndMark = 0;
+  p->ringWindow = 0;
+  p->reduceSize = (UInt64)(Int64)-1;
 }
 
 void LzmaEncProps_Normalize(CLzmaEncProps *p)
@@ -56,6 +58,15 @@ void LzmaEncProps_Normalize(CLzmaEncProps *p)
   if (level < 0) level = 5;
   p->level = level;
   if (p->dictSize == 0) p->dictSize = (level <= 5 ? (1 << (level * 2 + 14)) : (level == 6 ? (1 << 25) : (1 << 26)));
+  if (p->dictSize > p->reduceSize)
+  {
+    unsigned i;
+    for (i = 11; i <= 30; i++)
+    {
+      if ((UInt32)p->reduceSize <= ((UInt32)2 << i)) { p->dictSize = ((UInt32)2 << i); break; }
+      if ((UInt32)p->reduceSize <= ((UInt32)3 << i)) { p->dictSize = ((UInt32)3 << i); break; }
+    }
+  }
   if (p->lc < 0) p->lc = 3;
   if (p->lp < 0) p->lp = 0;
   if (p->pb < 0) p->pb = 2;
@@ -157,6 +168,8 @@ typedef struct
 
 #define kNumOpts (1 << 12)
 
+#define RC_BUF_SIZE (1 << 16)
+
 #define kNumLenToPosStates 4
 #define kNumPosSlotBits 6
 #define kDicLogSizeMin 0
@@ -333,6 +346,13 @@ typedef struct
 
   int needInit;
 
+  const UInt16 *model;
+  UInt64 memLimit;
+  CLzmaEncProps limitProps; /* the normalized props for the memory limit of the Prepare functions */
+
+  Byte *presetBuf;  /* the preset dictionary and the data of LzmaEnc_MemEncodeWithDict */
+  SizeT presetBufSize;
+
   CSaveState saveState;
 } CLzmaEnc;
 
@@ -388,6 +408,176 @@ void LzmaEnc_RestoreState(CLzmaEncHandle pp)
   memcpy(dest->litProbs, p->litProbs, (0x300 << dest->lclp) * sizeof(CLzmaProb));
 }
 
+static void CopyModelProbs(CLzmaProb *probs, UInt32 num, UInt16 *save, const UInt16 *load)
+{
+  UInt32 i;
+  if (save)
+    for (i = 0; i < num; i++)
+      save[i] = (UInt16)probs[i];
+  else
+    for (i = 0; i < num; i++)
+      probs[i] = load[i];
+}
+
+/* the order of tables is the same as in the decoder (LzmaDec.c) */
+
+static void LzmaEnc_CopyModel(CLzmaEnc *p, UInt16 *save, const UInt16 *load)
+{
+  UInt32 pos = 0;
+  unsigned i;
+  #define COPY_MODEL(probs, num) \
+    CopyModelProbs(probs, num, save ? save + pos : NULL, load ? load + pos : NULL); pos += (num);
+
+  COPY_MODEL(&p->isMatch[0][0], kNumStates * LZMA_NUM_PB_STATES_MAX)
+  COPY_MODEL(p->isRep, kNumStates)
+  COPY_MODEL(p->isRepG0, kNumStates)
+  COPY_MODEL(p->isRepG1, kNumStates)
+  COPY_MODEL(p->isRepG2, kNumStates)
+  COPY_MODEL(&p->isRep0Long[0][0], kNumStates * LZMA_NUM_PB_STATES_MAX)
+  COPY_MODEL(&p->posSlotEncoder[0][0], kNumLenToPosStates << kNumPosSlotBits)
+  COPY_MODEL(p->posEncoders, kNumFullDistances - kEndPosModelIndex)
+  COPY_MODEL(p->posAlignEncoder, 1 << kNumAlignBits)
+  for (i = 0; i < 2; i++)
+  {
+    CLenEnc *enc = (i == 0) ? &p->lenEnc.p : &p->repLenEnc.p;
+    COPY_MODEL(&enc->choice, 1)
+    COPY_MODEL(&enc->choice2, 1)
+    COPY_MODEL(enc->low, LZMA_NUM_PB_STATES_MAX << kLenNumLowBits)
+    COPY_MODEL(enc->mid, LZMA_NUM_PB_STATES_MAX << kLenNumMidBits)
+    COPY_MODEL(enc->high, kLenNumHighSymbols)
+  }
+  COPY_MODEL(p->litProbs, (UInt32)0x300 << (p->lc + p->lp))
+  #undef COPY_MODEL
+}
+
+void LzmaEnc_SetModel(CLzmaEncHandle pp, const UInt16 *probs)
+{
+  ((CLzmaEnc *)pp)->model = probs;
+}
+
+void LzmaEnc_SaveModel(CLzmaEncHandle pp, UInt16 *probs)
+{
+  LzmaEnc_CopyModel((CLzmaEnc *)pp, probs, NULL);
+}
+
+const void *LzmaEnc_GetMatchFinderBuf(CLzmaEncHandle pp)
+{
+  return ((CLzmaEnc *)pp)->matchFinderBase.hash;
+}
+
+static unsigned LzmaEncProps_GetNumFastBytes(const CLzmaEncProps *props)
+{
+  unsigned fb = props->fb;
+  if (fb < 5)
+    fb = 5;
+  if (fb > LZMA_MATCH_LEN_MAX)
+    fb = LZMA_MATCH_LEN_MAX;
+  return fb;
+}
+
+static UInt32 LzmaEncProps_GetNumHashBytes(const CLzmaEncProps *props)
+{
+  UInt32 numHashBytes = 4;
+  if (props->btMode)
+  {
+    if (props->numHashBytes < 2)
+      numHashBytes = 2;
+    else if (props->numHashBytes < 4)
+      numHashBytes = props->numHashBytes;
+  }
+  return numHashBytes;
+}
+
+#ifndef _7ZIP_ST
+static UInt32 LzmaEncProps_GetNumBtThreads(const CLzmaEncProps *props)
+{
+  UInt32 numBtThreads = (props->numThreads > 2) ? props->numThreads - 1 : 1;
+  if (numBtThreads > kMtBtNumThreadsMax)
+    numBtThreads = kMtBtNumThreadsMax;
+  return numBtThreads;
+}
+#endif
+
+/* props must be normalized. The window of the stream mode is not allocated with
+   (directInput), LZMA2 keeps (keepWindowSize) bytes before the current position. */
+
+static UInt64 LzmaEnc_EstimateMemory2(const CLzmaEncProps *props, int directInput, UInt32 keepWindowSize)
+{
+  UInt64 size = sizeof(CLzmaEnc) + RC_BUF_SIZE +
+      ((UInt64)0x300 << (props->lc + props->lp)) * sizeof(CLzmaProb) * 2;
+  unsigned fb = LzmaEncProps_GetNumFastBytes(props);
+  UInt32 numHashBytes = LzmaEncProps_GetNumHashBytes(props);
+  UInt32 beforeSize = kNumOpts;
+  if (beforeSize + props->dictSize < keepWindowSize)
+    beforeSize = keepWindowSize - props->dictSize;
+  #ifndef _7ZIP_ST
+  if (props->numThreads > 1 && props->algo != 0 && props->btMode)
+    return size + MatchFinderMt_EstimateMemory(props->dictSize, beforeSize, fb, LZMA_MATCH_LEN_MAX,
+        numHashBytes, LzmaEncProps_GetNumBtThreads(props), directInput);
+  #endif
+  return size + MatchFinder_EstimateMemory(props->dictSize, beforeSize, fb, LZMA_MATCH_LEN_MAX,
+      numHashBytes, props->btMode, directInput);
+}
+
+UInt64 LzmaEnc_EstimateMemory(const CLzmaEncProps *props2, int directInput)
+{
+  CLzmaEncProps props = *props2;
+  LzmaEncProps_Normalize(&props);
+  if (props.lc > LZMA_LC_MAX || props.lp > LZMA_LP_MAX)
+    return 0;
+  return LzmaEnc_EstimateMemory2(&props, directInput, 0);
+}
+
+void LzmaEnc_SetMemLimit(CLzmaEncHandle pp, UInt64 memLimit)
+{
+  ((CLzmaEnc *)pp)->memLimit = memLimit;
+}
+
+/* over the limit: single thread mode first (it doesn't change the ratio),
+   then the smaller dictionary (the hash tables follow it).
+   (bufSize) is the other memory of the encoder (see LzmaEnc_MemEncodeWithDict). */
+
+static SRes LzmaEnc_LimitProps(CLzmaEncProps *props, UInt64 memLimit,
+    int directInput, UInt32 keepWindowSize, UInt64 bufSize)
+{
+  if (memLimit != 0)
+    while (LzmaEnc_EstimateMemory2(props, directInput, keepWindowSize) + bufSize > memLimit)
+    {
+      if (props->numThreads > 1)
+        props->numThreads = 1;
+      else if (props->dictSize > ((UInt32)1 << 12))
+      {
+        props->dictSize >>= 1;
+        if (props->dictSize < ((UInt32)1 << 12))
+          props->dictSize = ((UInt32)1 << 12);
+      }
+      else
+        return SZ_ERROR_MEM;
+    }
+  return SZ_OK;
+}
+
+/* The input mode is known only in the Prepare functions, so LzmaEnc_SetProps checks
+   the smallest case (directInput) and LzmaEnc_CheckMemLimit reduces the props again.
+   The dictionary can only be reduced: the written properties remain correct. */
+
+static SRes LzmaEnc_CheckMemLimit(CLzmaEnc *p, int directInput, UInt32 keepWindowSize, UInt64 bufSize)
+{
+  CLzmaEncProps props = p->limitProps;
+  props.dictSize = p->dictSize;
+  #ifndef _7ZIP_ST
+  if (!p->multiThread)
+  #endif
+    props.numThreads = 1;
+  RINOK(LzmaEnc_LimitProps(&props, p->memLimit, directInput, keepWindowSize, bufSize));
+  p->dictSize = props.dictSize;
+  #ifndef _7ZIP_ST
+  if (props.numThreads == 1)
+    p->multiThread = False;
+  #endif
+  return SZ_OK;
+}
+
 SRes LzmaEnc_SetProps(CLzmaEncHandle pp, const CLzmaEncProps *props2)
 {
   CLzmaEnc *p = (CLzmaEnc *)pp;
@@ -397,34 +587,22 @@ SRes LzmaEnc_SetProps(CLzmaEncHandle pp, const CLzmaEncProps *props2)
   if (props.lc > LZMA_LC_MAX || props.lp > LZMA_LP_MAX || props.pb > LZMA_PB_MAX ||
       props.dictSize > ((UInt32)1 << kDicLogSizeMaxCompress) || props.dictSize > ((UInt32)1 << 30))
     return SZ_ERROR_PARAM;
+
+  RINOK(LzmaEnc_LimitProps(&props, p->memLimit, 1, 0, 0));
+  p->limitProps = props;
+
   p->dictSize = props.dictSize;
   p->matchFinderCycles = props.mc;
-  {
-    unsigned fb = props.fb;
-    if (fb < 5)
-      fb = 5;
-    if (fb > LZMA_MATCH_LEN_MAX)
-      fb = LZMA_MATCH_LEN_MAX;
-    p->numFastBytes = fb;
-  }
+  p->numFastBytes = LzmaEncProps_GetNumFastBytes(&props);
   p->lc = props.lc;
   p->lp = props.lp;
   p->pb = props.pb;
   p->fastMode = (props.algo == 0);
   p->matchFinderBase.btMode = props.btMode;
-  {
-    UInt32 numHashBytes = 4;
-    if (props.btMode)
-    {
-      if (props.numHashBytes < 2)
-        numHashBytes = 2;
-      else if (props.numHashBytes < 4)
-        numHashBytes = props.numHashBytes;
-    }
-    p->matchFinderBase.numHashBytes = numHashBytes;
-  }
+  p->matchFinderBase.numHashBytes = LzmaEncProps_GetNumHashBytes(&props);
 
   p->matchFinderBase.cutValue = props.mc;
+  p->matchFinderBase.ringWindow = props.ringWindow;
 
   p->writeEndMark = props.writeEndMark;
 
@@ -437,6 +615,7 @@ SRes LzmaEnc_SetProps(CLzmaEncHandle pp, const CLzmaEncProps *props2)
   }
   */
   p->multiThread = (props.numThreads > 1);
+  p->matchFinderMt.numBtThreads = LzmaEncProps_GetNumBtThreads(&props);
   #endif
 
   return SZ_OK;
@@ -461,7 +640,6 @@ static void RangeEnc_Construct(CRangeEnc *p)
 
 #define RangeEnc_GetProcessed(p) ((p)->processed + ((p)->buf - (p)->bufBase) + (p)->cacheSize)
 
-#define RC_BUF_SIZE (1 << 16)
 static int RangeEnc_Alloc(CRangeEnc *p, ISzAlloc *alloc)
 {
   if (p->bufBase == 0)
@@ -1675,6 +1853,7 @@ static void FillDistancesPrices(CLzmaEnc *p)
 
 void LzmaEnc_Construct(CLzmaEnc *p)
 {
+  p->memLimit = 0;
   RangeEnc_Construct(&p->rc);
   MatchFinder_Construct(&p->matchFinderBase);
   #ifndef _7ZIP_ST
@@ -1695,6 +1874,9 @@ void LzmaEnc_Construct(CLzmaEnc *p)
   LzmaEnc_InitPriceTables(p->ProbPrices);
   p->litProbs = 0;
   p->saveState.litProbs = 0;
+  p->model = NULL;
+  p->presetBuf = 0;
+  p->presetBufSize = 0;
 }
 
 CLzmaEncHandle LzmaEnc_Create(ISzAlloc *alloc)
@@ -1722,6 +1904,9 @@ void LzmaEnc_Destruct(CLzmaEnc *p, ISzAlloc *alloc, ISzAlloc *allocBig)
   MatchFinder_Free(&p->matchFinderBase, allocBig);
   LzmaEnc_FreeLits(p, alloc);
   RangeEnc_Free(&p->rc, alloc);
+  alloc->Free(alloc, p->presetBuf);
+  p->presetBuf = 0;
+  p->presetBufSize = 0;
 }
 
 void LzmaEnc_Destroy(CLzmaEncHandle p, ISzAlloc *alloc, ISzAlloc *allocBig)
@@ -1994,6 +2179,9 @@ void LzmaEnc_Init(CLzmaEnc *p)
   for (i = 0; i < (1 << kNumAlignBits); i++)
     p->posAlignEncoder[i] = kProbInitValue;
 
+  if (p->model)
+    LzmaEnc_CopyModel(p, NULL, p->model);
+
   p->optimumEndIndex = 0;
   p->optimumCurrentIndex = 0;
   p->additionalOffset = 0;
@@ -2020,6 +2208,7 @@ void LzmaEnc_InitPrices(CLzmaEnc *p)
 static SRes LzmaEnc_AllocAndInit(CLzmaEnc *p, UInt32 keepWindowSize, ISzAlloc *alloc, ISzAlloc *allocBig)
 {
   UInt32 i;
+  RINOK(LzmaEnc_CheckMemLimit(p, p->matchFinderBase.directInput, keepWindowSize, p->presetBufSize));
   for (i = 0; i < (UInt32)kDicLogSizeMaxCompress; i++)
     if (p->dictSize <= ((UInt32)1 << i))
       break;
@@ -2034,11 +2223,32 @@ static SRes LzmaEnc_AllocAndInit(CLzmaEnc *p, UInt32 keepWindowSize, ISzAlloc *a
   return SZ_OK;
 }
 
+/* In directInput mode bufferBase of the match finder points to the input.
+   The window buffer of the stream mode is allocated again after the switch. */
+
+static void LzmaEnc_SetInputStream(CLzmaEnc *p, ISeqInStream *inStream)
+{
+  if (p->matchFinderBase.directInput)
+  {
+    p->matchFinderBase.directInput = 0;
+    p->matchFinderBase.bufferBase = 0;
+  }
+  p->matchFinderBase.stream = inStream;
+}
+
+static void LzmaEnc_SetInputBuf(CLzmaEnc *p, const Byte *src, SizeT srcLen, ISzAlloc *allocBig)
+{
+  MatchFinder_FreeWindow(&p->matchFinderBase, allocBig);
+  p->matchFinderBase.directInput = 1;
+  p->matchFinderBase.bufferBase = (Byte *)src;
+  p->matchFinderBase.directInputRem = srcLen;
+}
+
 static SRes LzmaEnc_Prepare(CLzmaEncHandle pp, ISeqOutStream *outStream, ISeqInStream *inStream,
     ISzAlloc *alloc, ISzAlloc *allocBig)
 {
   CLzmaEnc *p = (CLzmaEnc *)pp;
-  p->matchFinderBase.stream = inStream;
+  LzmaEnc_SetInputStream(p, inStream);
   p->needInit = 1;
   p->rc.outStream = outStream;
   return LzmaEnc_AllocAndInit(p, 0, alloc, allocBig);
@@ -2049,23 +2259,16 @@ SRes LzmaEnc_PrepareForLzma2(CLzmaEncHandle pp,
     ISzAlloc *alloc, ISzAlloc *allocBig)
 {
   CLzmaEnc *p = (CLzmaEnc *)pp;
-  p->matchFinderBase.stream = inStream;
+  LzmaEnc_SetInputStream(p, inStream);
   p->needInit = 1;
   return LzmaEnc_AllocAndInit(p, keepWindowSize, alloc, allocBig);
 }
 
-static void LzmaEnc_SetInputBuf(CLzmaEnc *p, const Byte *src, SizeT srcLen)
-{
-  p->matchFinderBase.directInput = 1;
-  p->matchFinderBase.bufferBase = (Byte *)src;
-  p->matchFinderBase.directInputRem = srcLen;
-}
-
 SRes LzmaEnc_MemPrepare(CLzmaEncHandle pp, const Byte *src, SizeT srcLen,
     UInt32 keepWindowSize, ISzAlloc *alloc, ISzAlloc *allocBig)
 {
   CLzmaEnc *p = (CLzmaEnc *)pp;
-  LzmaEnc_SetInputBuf(p, src, srcLen);
+  LzmaEnc_SetInputBuf(p, src, srcLen, allocBig);
   p->needInit = 1;
 
   return LzmaEnc_AllocAndInit(p, keepWindowSize, alloc, allocBig);
@@ -2117,6 +2320,22 @@ const Byte *LzmaEnc_GetCurBuf(CLzmaEncHandle pp)
   return p->matchFinder.GetPointerToCurrentPos(p->matchFinderObj) - p->additionalOffset;
 }
 
+/* LzmaEnc_SkipMemBlock moves (size) bytes into the dictionary without encoding.
+   The state is not changed, as in the decoder for uncompressed chunks. */
+
+void LzmaEnc_SkipMemBlock(CLzmaEncHandle pp, UInt32 size)
+{
+  CLzmaEnc *p = (CLzmaEnc *)pp;
+  if (p->needInit)
+  {
+    p->matchFinder.Init(p->matchFinderObj);
+    p->needInit = 0;
+  }
+  if (size != 0)
+    p->matchFinder.Skip(p->matchFinderObj, size);
+  p->nowPos64 += size;
+}
+
 SRes LzmaEnc_CodeOneMemBlock(CLzmaEncHandle pp, Bool reInit,
     Byte *dest, size_t *destLen, UInt32 desiredPackSize, UInt32 *unpackSize)
 {
@@ -2188,6 +2407,30 @@ SRes LzmaEnc_Encode(CLzmaEncHandle pp, ISeqOutStream *outStream, ISeqInStream *i
   return LzmaEnc_Encode2((CLzmaEnc *)pp, progress);
 }
 
+SRes LzmaEnc_StreamPrepare(CLzmaEncHandle pp, ISeqOutStream *outStream, ISeqInStream *inStream,
+    ISzAlloc *alloc, ISzAlloc *allocBig)
+{
+  #ifndef _7ZIP_ST
+  /* the threads of the match finder would read inStream at any time */
+  ((CLzmaEnc *)pp)->multiThread = False;
+  #endif
+  return LzmaEnc_Prepare(pp, outStream, inStream, alloc, allocBig);
+}
+
+/* One LzmaEnc_CodeOneBlock call encodes about 32 KB, and the match finder reads up to
+   (kNumOpts + keepSizeAfter) bytes ahead of the encoder. So inStream always has the
+   data that is requested, if the block starts LZMA_STREAM_LOOKAHEAD bytes before inSize. */
+
+SRes LzmaEnc_StreamCode(CLzmaEncHandle pp, UInt64 inSize, Bool finish)
+{
+  CLzmaEnc *p = (CLzmaEnc *)pp;
+  while (!p->finished && (finish || inSize - p->nowPos64 >= LZMA_STREAM_LOOKAHEAD))
+  {
+    RINOK(LzmaEnc_CodeOneBlock(p, False, 0, 0));
+  }
+  return SZ_OK;
+}
+
 SRes LzmaEnc_WriteProperties(CLzmaEncHandle pp, Byte *props, SizeT *size)
 {
   CLzmaEnc *p = (CLzmaEnc *)pp;
@@ -2225,7 +2468,7 @@ SRes LzmaEnc_MemEncode(CLzmaEncHandle pp, Byte *dest, SizeT *destLen, const Byte
 
   CSeqOutStreamBuf outStream;
 
-  LzmaEnc_SetInputBuf(p, src, srcLen);
+  LzmaEnc_SetInputBuf(p, src, srcLen, allocBig);
 
   outStream.funcTable.Write = MyWrite;
   outStream.data = dest;
@@ -2245,6 +2488,82 @@ SRes LzmaEnc_MemEncode(CLzmaEncHandle pp, Byte *dest, SizeT *destLen, const Byte
   return res;
 }
 
+SRes LzmaEnc_MemEncodeToStream(CLzmaEncHandle pp, ISeqOutStream *outStream, const Byte *src, SizeT srcLen,
+    int writeEndMark, ICompressProgress *progress, ISzAlloc *alloc, ISzAlloc *allocBig)
+{
+  CLzmaEnc *p = (CLzmaEnc *)pp;
+  SRes res;
+  p->writeEndMark = writeEndMark;
+  p->rc.outStream = outStream;
+  RINOK(LzmaEnc_MemPrepare(pp, src, srcLen, 0, alloc, allocBig));
+  res = LzmaEnc_Encode2(p, progress);
+  /* the header of the caller has srcLen as the unpacked size */
+  if (res == SZ_OK && p->nowPos64 != srcLen)
+    res = SZ_ERROR_FAIL;
+  return res;
+}
+
+SRes LzmaEnc_MemEncodeWithDict(CLzmaEncHandle pp, Byte *dest, SizeT *destLen, const Byte *src, SizeT srcLen,
+    const Byte *dict, SizeT dictLen, int writeEndMark, ICompressProgress *progress,
+    ISzAlloc *alloc, ISzAlloc *allocBig)
+{
+  SRes res;
+  CLzmaEnc *p = (CLzmaEnc *)pp;
+  CSeqOutStreamBuf outStream;
+  SizeT presetSize = dictLen;
+
+  if (dictLen == 0)
+    return LzmaEnc_MemEncode(pp, dest, destLen, src, srcLen, writeEndMark, progress, alloc, allocBig);
+
+  /* only the last (dictSize) bytes of dict can be referenced */
+  if (presetSize > p->dictSize)
+    presetSize = p->dictSize;
+  if (srcLen > (SizeT)0 - 1 - presetSize)
+    return SZ_ERROR_PARAM;
+  /* the limit is checked before the buffer is allocated, the dictionary can be reduced */
+  RINOK(LzmaEnc_CheckMemLimit(p, 1, 0,
+      p->presetBufSize > presetSize + srcLen ? p->presetBufSize : presetSize + srcLen));
+  if (presetSize > p->dictSize)
+    presetSize = p->dictSize;
+  /* the buffer is kept for the next messages, it only grows */
+  if (p->presetBufSize < presetSize + srcLen)
+  {
+    alloc->Free(alloc, p->presetBuf);
+    p->presetBufSize = 0;
+    p->presetBuf = (Byte *)alloc->Alloc(alloc, presetSize + srcLen);
+    if (p->presetBuf == 0)
+      return SZ_ERROR_MEM;
+    p->presetBufSize = presetSize + srcLen;
+  }
+  memcpy(p->presetBuf, dict + dictLen - presetSize, presetSize);
+  memcpy(p->presetBuf + presetSize, src, srcLen);
+
+  outStream.funcTable.Write = MyWrite;
+  outStream.data = dest;
+  outStream.rem = *destLen;
+  outStream.overflow = False;
+
+  p->writeEndMark = writeEndMark;
+
+  p->rc.outStream = &outStream.funcTable;
+  res = LzmaEnc_MemPrepare(pp, p->presetBuf, presetSize + srcLen, 0, alloc, allocBig);
+  if (res == SZ_OK)
+  {
+    /* the preset is inserted to the match finder, but it's not encoded.
+       The position continues from dictLen, as in the decoder (LzmaDec_SetPresetDict). */
+    p->matchFinder.Init(p->matchFinderObj);
+    p->needInit = 0;
+    p->matchFinder.Skip(p->matchFinderObj, (UInt32)presetSize);
+    p->nowPos64 = dictLen;
+    res = LzmaEnc_Encode2(p, progress);
+  }
+
+  *destLen -= outStream.rem;
+  if (outStream.overflow)
+    return SZ_ERROR_OUTPUT_EOF;
+  return res;
+}
+
 SRes LzmaEncode(Byte *dest, SizeT *destLen, const Byte *src, SizeT srcLen,
     const CLzmaEncProps *props, Byte *propsEncoded, SizeT *propsSize, int writeEndMark,
     ICompressProgress *progress, ISzAlloc *alloc, ISzAlloc *allocBig)
@@ -27,7 +27,12 @@ typedef struct _CLzmaEncProps
   int numHashBytes; /* 2, 3 or 4, default = 4 */
   UInt32 mc;        /* 1 <= mc <= (1 << 30), default = 32 */
   unsigned writeEndMark;  /* 0 - do not write EOPM, 1 - write EOPM, default = 0 */
-  int numThreads;  /* 1 or 2, default = 2 */
+  int numThreads;  /* 1 <= numThreads <= 16, default = 2 */
+  int ringWindow;  /* 1 - the window of LzmaEnc_Encode is a ring mapped twice (RingAlloc), if the
+                      system allows it: there is no memmove of the dictionary, but the window is
+                      not allocated from allocBig. default = 0 */
+  UInt64 reduceSize; /* estimated size of data that will be compressed. default = (UInt64)(Int64)-1.
+                        Encoder uses this value to reduce dictionary size */
 } CLzmaEncProps;
 
 void LzmaEncProps_Init(CLzmaEncProps *p);
@@ -52,12 +57,80 @@ typedef void * CLzmaEncHandle;
 CLzmaEncHandle LzmaEnc_Create(ISzAlloc *alloc);
 void LzmaEnc_Destroy(CLzmaEncHandle p, ISzAlloc *alloc, ISzAlloc *allocBig);
 SRes LzmaEnc_SetProps(CLzmaEncHandle p, const CLzmaEncProps *props);
+
+/* LzmaEnc_EstimateMemory returns the number of bytes that the encoder allocates for
+   these props (including the encoder object). With (directInput) it's the size
+   for LzmaEnc_MemEncode, else for LzmaEnc_Encode, that also allocates the window
+   buffer (about dictSize * 1.5 bytes). It returns 0 for incorrect lc / lp.
+
+   LzmaEnc_SetMemLimit sets the limit for the next encodings (0 - no limit).
+   If the estimate is larger than the limit, the encoder uses one thread and then
+   reduces dictSize (down to 4 KB). LzmaEnc_SetProps checks the estimate of
+   LzmaEnc_MemEncode, the encoding functions check it again for their input mode
+   (and the buffer of LzmaEnc_MemEncodeWithDict), so the dictionary can be smaller
+   than in the written properties. They return SZ_ERROR_MEM, if that is not enough. */
+
+UInt64 LzmaEnc_EstimateMemory(const CLzmaEncProps *props, int directInput);
+void LzmaEnc_SetMemLimit(CLzmaEncHandle p, UInt64 memLimit);
+
+/* LzmaEnc_GetMatchFinderBuf returns the block of allocBig with the hash table and the
+   binary tree of the match finder (the largest buffer of the encoder), or NULL before
+   the first encoding. The encoder keeps it for the next encodings. */
+
+const void *LzmaEnc_GetMatchFinderBuf(CLzmaEncHandle p);
 SRes LzmaEnc_WriteProperties(CLzmaEncHandle p, Byte *properties, SizeT *size);
 SRes LzmaEnc_Encode(CLzmaEncHandle p, ISeqOutStream *outStream, ISeqInStream *inStream,
     ICompressProgress *progress, ISzAlloc *alloc, ISzAlloc *allocBig);
 SRes LzmaEnc_MemEncode(CLzmaEncHandle p, Byte *dest, SizeT *destLen, const Byte *src, SizeT srcLen,
     int writeEndMark, ICompressProgress *progress, ISzAlloc *alloc, ISzAlloc *allocBig);
 
+/* LzmaEnc_MemEncodeToStream is the same as LzmaEnc_MemEncode (src is read directly,
+   there is no window buffer), but the packed data is written to outStream. */
+
+SRes LzmaEnc_MemEncodeToStream(CLzmaEncHandle p, ISeqOutStream *outStream, const Byte *src, SizeT srcLen,
+    int writeEndMark, ICompressProgress *progress, ISzAlloc *alloc, ISzAlloc *allocBig);
+
+/* Push mode: the caller gets the input in parts (for example, std::streambuf).
+   LzmaEnc_StreamPrepare is the same as LzmaEnc_Encode, but it doesn't encode.
+   The match finder is single-threaded: inStream is read only within the next calls.
+   LzmaEnc_StreamCode(p, inSize, finish) - inSize is the number of bytes that were
+   given to inStream so far. Without finish it encodes while more than
+   LZMA_STREAM_LOOKAHEAD of them are after the encoder position, so inStream->Read
+   is never called for the data that the caller doesn't have yet: it must return
+   0 bytes only at the end. After the call less than LZMA_STREAM_LOOKAHEAD bytes
+   are not read from inStream. With finish it encodes all the rest of inStream
+   and flushes the stream (with the end mark, if writeEndMark is set). */
+
+SRes LzmaEnc_StreamPrepare(CLzmaEncHandle p, ISeqOutStream *outStream, ISeqInStream *inStream,
+    ISzAlloc *alloc, ISzAlloc *allocBig);
+SRes LzmaEnc_StreamCode(CLzmaEncHandle p, UInt64 inSize, Bool finish);
+
+/* LzmaEnc_MemEncodeWithDict is the same as LzmaEnc_MemEncode, but the match finder
+   is filled with the preset dictionary (dict) first, so src can refer to it.
+   The dictionary is not written to dest. The decoder must be initialized with
+   the same dictionary (LzmaDec_SetPresetDict). Only the last dictSize bytes of
+   dict are used. The dictionary and src are copied to a buffer of
+   (min(dictLen, dictSize) + srcLen) bytes from alloc. The encoder keeps it for
+   the next calls and grows it only for a bigger message; LzmaEnc_Destroy frees it. */
+
+SRes LzmaEnc_MemEncodeWithDict(CLzmaEncHandle p, Byte *dest, SizeT *destLen, const Byte *src, SizeT srcLen,
+    const Byte *dict, SizeT dictLen, int writeEndMark, ICompressProgress *progress,
+    ISzAlloc *alloc, ISzAlloc *allocBig);
+
+/* Probability model snapshots.
+   The model is the array of LZMA_MODEL_NUM_PROBS(lc, lp) probabilities in the order
+   of the decoder tables (LzmaDec.c), it doesn't depend on _LZMA_PROB32.
+   LzmaEnc_SaveModel writes the probabilities after the last encoding.
+   LzmaEnc_SetModel(p, probs) - the encoder starts each stream with (probs) instead of
+   the default probabilities, and the decoder must use LzmaDec_InitModel with the same
+   model. (probs) is not copied, it must be available until the encoding is finished.
+   lc and lp of the model must be the same as in props. NULL restores the default. */
+
+#define LZMA_MODEL_NUM_PROBS(lc, lp) ((UInt32)1846 + ((UInt32)0x300 << ((lc) + (lp))))
+
+void LzmaEnc_SetModel(CLzmaEncHandle p, const UInt16 *probs);
+void LzmaEnc_SaveModel(CLzmaEncHandle p, UInt16 *probs);
+
 /* ---------- One Call Interface ---------- */
 
 /* LzmaEncode
@@ -0,0 +1,401 @@
+/* LzmaFile.c -- LZMA file compression with memory-mapped input
+2026-10-17 : Public domain */
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#define _FILE_OFFSET_BITS 64
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include <stdio.h>
+
+#include "Alloc.h"
+#include "LzmaEnc.h"
+#include "LzmaLib.h"
+
+#define LZMA_FILE_HEADER_SIZE (LZMA_PROPS_SIZE + 8)
+#define LZMA_FILE_SIZE_UNKNOWN ((UInt64)(Int64)-1)
+
+/* the pages of the mapping that are older than the dictionary are released in
+   steps of LZMA_FILE_RELEASE_STEP bytes (it's a multiple of the page size) */
+#define LZMA_FILE_RELEASE_STEP ((UInt64)1 << 26)
+#define LZMA_FILE_RELEASE_RESERVE ((UInt64)1 << 20)
+
+static void *SzAlloc(void *p, size_t size) { p = p; return MyAlloc(size); }
+static void SzFree(void *p, void *address) { p = p; MyFree(address); }
+static ISzAlloc g_Alloc = { SzAlloc, SzFree };
+static void *SzBigAlloc(void *p, size_t size) { p = p; return BigAlloc(size); }
+static void SzBigFree(void *p, void *address) { p = p; BigFree(address); }
+static ISzAlloc g_BigAlloc = { SzBigAlloc, SzBigFree };
+
+static UInt32 GetUi32(const Byte *p)
+{
+  return p[0] | ((UInt32)p[1] << 8) | ((UInt32)p[2] << 16) | ((UInt32)p[3] << 24);
+}
+
+static void SetUi64(Byte *p, UInt64 v)
+{
+  int i;
+  for (i = 0; i < 8; i++)
+    p[i] = (Byte)(v >> (8 * i));
+}
+
+/* ---------- Input file ---------- */
+
+/* The file is mapped, if it's a regular file that fits the address space.
+   Otherwise (view == NULL) it's read by funcTable, and the match finder copies
+   it to its window as in LzmaEnc_Encode. */
+
+typedef struct
+{
+  ISeqInStream funcTable;  /* must be first */
+  #ifdef _WIN32
+  HANDLE file;
+  HANDLE mapping;
+  #else
+  int fd;
+  #endif
+  UInt64 size;  /* LZMA_FILE_SIZE_UNKNOWN for pipes and devices */
+  const Byte *view;
+} CInFile;
+
+#ifdef _WIN32
+
+static SRes InFile_Read(void *pp, void *buf, size_t *size)
+{
+  CInFile *p = (CInFile *)pp;
+  DWORD processed = 0;
+  DWORD curSize = (*size > ((DWORD)1 << 30)) ? ((DWORD)1 << 30) : (DWORD)*size;
+  BOOL ok = ReadFile(p->file, buf, curSize, &processed, NULL);
+  *size = processed;
+  return ok ? SZ_OK : SZ_ERROR_READ;
+}
+
+static SRes InFile_Open(CInFile *p, const char *path)
+{
+  LARGE_INTEGER size;
+  p->funcTable.Read = InFile_Read;
+  p->mapping = NULL;
+  p->view = NULL;
+  p->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+      FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  if (p->file == INVALID_HANDLE_VALUE)
+    return SZ_ERROR_READ;
+  if (GetFileType(p->file) != FILE_TYPE_DISK || !GetFileSizeEx(p->file, &size))
+  {
+    p->size = LZMA_FILE_SIZE_UNKNOWN;
+    return SZ_OK;
+  }
+  p->size = (UInt64)size.QuadPart;
+  if (p->size != 0 && (UInt64)(SIZE_T)p->size == p->size)
+  {
+    p->mapping = CreateFileMappingA(p->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (p->mapping != NULL)
+    {
+      p->view = (const Byte *)MapViewOfFile(p->mapping, FILE_MAP_READ, 0, 0, 0);
+      if (p->view == NULL)
+      {
+        CloseHandle(p->mapping);
+        p->mapping = NULL;
+      }
+    }
+  }
+  return SZ_OK;
+}
+
+static void InFile_Release(CInFile *p, UInt64 from, UInt64 to)
+{
+  /* Windows trims the working set of the mapped view itself */
+  p = p;
+  from = from;
+  to = to;
+}
+
+static void InFile_Close(CInFile *p)
+{
+  if (p->view != NULL)
+    UnmapViewOfFile(p->view);
+  if (p->mapping != NULL)
+    CloseHandle(p->mapping);
+  CloseHandle(p->file);
+}
+
+#else
+
+static SRes InFile_Read(void *pp, void *buf, size_t *size)
+{
+  CInFile *p = (CInFile *)pp;
+  ssize_t processed;
+  do
+    processed = read(p->fd, buf, (*size > ((size_t)1 << 30)) ? ((size_t)1 << 30) : *size);
+  while (processed < 0 && errno == EINTR);
+  if (processed < 0)
+  {
+    *size = 0;
+    return SZ_ERROR_READ;
+  }
+  *size = (size_t)processed;
+  return SZ_OK;
+}
+
+static SRes InFile_Open(CInFile *p, const char *path)
+{
+  struct stat st;
+  p->funcTable.Read = InFile_Read;
+  p->view = NULL;
+  p->fd = open(path, O_RDONLY);
+  if (p->fd < 0)
+    return SZ_ERROR_READ;
+  if (fstat(p->fd, &st) != 0 || !S_ISREG(st.st_mode))
+  {
+    p->size = LZMA_FILE_SIZE_UNKNOWN;
+    return SZ_OK;
+  }
+  p->size = (UInt64)st.st_size;
+  if (p->size != 0 && (UInt64)(size_t)p->size == p->size)
+  {
+    void *view = mmap(0, (size_t)p->size, PROT_READ, MAP_PRIVATE, p->fd, 0);
+    if (view != MAP_FAILED)
+    {
+      p->view = (const Byte *)view;
+      #ifdef MADV_SEQUENTIAL
+      madvise(view, (size_t)p->size, MADV_SEQUENTIAL);
+      #endif
+    }
+  }
+  return SZ_OK;
+}
+
+static void InFile_Release(CInFile *p, UInt64 from, UInt64 to)
+{
+  #ifdef MADV_DONTNEED
+  madvise((void *)(p->view + from), (size_t)(to - from), MADV_DONTNEED);
+  #endif
+}
+
+static void InFile_Close(CInFile *p)
+{
+  if (p->view != NULL)
+    munmap((void *)p->view, (size_t)p->size);
+  close(p->fd);
+}
+
+#endif
+
+/* The encoder reads the mapping up to dictSize bytes back from the current
+   position. The older pages are released, so the resident size of the mapping
+   doesn't grow with the file. */
+
+typedef struct
+{
+  ICompressProgress funcTable;  /* must be first */
+  CInFile *file;
+  UInt64 keepSize;
+  UInt64 released;
+} CReleaseProgress;
+
+static SRes ReleaseProgress(void *pp, UInt64 inSize, UInt64 outSize)
+{
+  CReleaseProgress *p = (CReleaseProgress *)pp;
+  outSize = outSize;
+  if (inSize >= p->released + p->keepSize + LZMA_FILE_RELEASE_STEP)
+  {
+    UInt64 to = (inSize - p->keepSize) & ~(LZMA_FILE_RELEASE_STEP - 1);
+    InFile_Release(p->file, p->released, to);
+    p->released = to;
+  }
+  return SZ_OK;
+}
+
+/* ---------- Output file ---------- */
+
+/* The encoder writes its range coder buffer (64 KB) directly to the file.
+   The destination can also be a pipe or a device: it's written sequentially
+   then, and it's not removed on errors. */
+
+typedef struct
+{
+  ISeqOutStream funcTable;  /* must be first */
+  #ifdef _WIN32
+  HANDLE file;
+  #else
+  int fd;
+  UInt64 pos;
+  #endif
+  int isFile;  /* regular file that is created or truncated by OutFile_Open */
+} COutFile;
+
+#ifdef _WIN32
+
+static size_t OutFile_Write(void *pp, const void *data, size_t size)
+{
+  COutFile *p = (COutFile *)pp;
+  size_t written = 0;
+  while (written != size)
+  {
+    DWORD processed = 0;
+    DWORD curSize = (size - written > ((DWORD)1 << 30)) ? ((DWORD)1 << 30) : (DWORD)(size - written);
+    if (!WriteFile(p->file, (const Byte *)data + written, curSize, &processed, NULL) || processed == 0)
+      break;
+    written += processed;
+  }
+  return written;
+}
+
+/* The source is open without FILE_SHARE_WRITE, so the same file can't be open here. */
+
+static SRes OutFile_Open(COutFile *p, const char *path, const CInFile *in)
+{
+  in = in;
+  p->funcTable.Write = OutFile_Write;
+  p->file = CreateFileA(path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (p->file == INVALID_HANDLE_VALUE)
+    return SZ_ERROR_WRITE;
+  p->isFile = (GetFileType(p->file) == FILE_TYPE_DISK);
+  return SZ_OK;
+}
+
+static SRes OutFile_Close(COutFile *p, SRes res)
+{
+  if (!CloseHandle(p->file) && res == SZ_OK)
+    res = SZ_ERROR_WRITE;
+  return res;
+}
+
+#else
+
+static size_t OutFile_Write(void *pp, const void *data, size_t size)
+{
+  COutFile *p = (COutFile *)pp;
+  size_t written = 0;
+  while (written != size)
+  {
+    ssize_t processed = p->isFile ?
+        pwrite(p->fd, (const Byte *)data + written, size - written, (off_t)p->pos) :
+        write(p->fd, (const Byte *)data + written, size - written);
+    if (processed < 0 && errno == EINTR)
+      continue;
+    if (processed <= 0)
+      break;
+    written += (size_t)processed;
+    p->pos += (size_t)processed;
+  }
+  return written;
+}
+
+/* The file is truncated only after the check that it's not the source. */
+
+static SRes OutFile_Open(COutFile *p, const char *path, const CInFile *in)
+{
+  struct stat st, inSt;
+  p->funcTable.Write = OutFile_Write;
+  p->pos = 0;
+  p->fd = open(path, O_WRONLY | O_CREAT, 0666);
+  if (p->fd < 0)
+    return SZ_ERROR_WRITE;
+  if (fstat(p->fd, &st) != 0)
+  {
+    close(p->fd);
+    return SZ_ERROR_WRITE;
+  }
+  if (fstat(in->fd, &inSt) == 0 && st.st_dev == inSt.st_dev && st.st_ino == inSt.st_ino)
+  {
+    close(p->fd);
+    return SZ_ERROR_PARAM;
+  }
+  p->isFile = S_ISREG(st.st_mode);
+  if (p->isFile && ftruncate(p->fd, 0) != 0)
+  {
+    close(p->fd);
+    return SZ_ERROR_WRITE;
+  }
+  return SZ_OK;
+}
+
+static SRes OutFile_Close(COutFile *p, SRes res)
+{
+  if (close(p->fd) != 0 && res == SZ_OK)
+    res = SZ_ERROR_WRITE;
+  return res;
+}
+
+#endif
+
+/* ---------- LzmaCompressFile ---------- */
+
+static SRes CompressFile(CLzmaEncHandle enc, CInFile *in, COutFile *out,
+  int level, unsigned dictSize, int lc, int lp, int pb, int fb, int numThreads)
+{
+  CLzmaEncProps props;
+  Byte header[LZMA_FILE_HEADER_SIZE];
+  SizeT propsSize = LZMA_PROPS_SIZE;
+
+  LzmaEncProps_Init(&props);
+  props.reduceSize = in->size;
+  props.level = level;
+  props.dictSize = dictSize;
+  props.lc = lc;
+  props.lp = lp;
+  props.pb = pb;
+  props.fb = fb;
+  props.numThreads = numThreads;
+  props.writeEndMark = (in->size == LZMA_FILE_SIZE_UNKNOWN);
+  props.ringWindow = 1;
+  RINOK(LzmaEnc_SetProps(enc, &props));
+  RINOK(LzmaEnc_WriteProperties(enc, header, &propsSize));
+  SetUi64(header + LZMA_PROPS_SIZE, in->size);
+  if (out->funcTable.Write(out, header, LZMA_FILE_HEADER_SIZE) != LZMA_FILE_HEADER_SIZE)
+    return SZ_ERROR_WRITE;
+
+  if (in->view != NULL)
+  {
+    CReleaseProgress progress;
+    progress.funcTable.Progress = ReleaseProgress;
+    progress.file = in;
+    progress.keepSize = GetUi32(header + 1) + LZMA_FILE_RELEASE_RESERVE;
+    progress.released = 0;
+    return LzmaEnc_MemEncodeToStream(enc, &out->funcTable, in->view, (SizeT)in->size,
+        props.writeEndMark, &progress.funcTable, &g_Alloc, &g_BigAlloc);
+  }
+  if (in->size == 0)
+    return LzmaEnc_MemEncodeToStream(enc, &out->funcTable, header, 0,
+        props.writeEndMark, NULL, &g_Alloc, &g_BigAlloc);
+  return LzmaEnc_Encode(enc, &out->funcTable, &in->funcTable, NULL, &g_Alloc, &g_BigAlloc);
+}
+
+int WINAPI LzmaCompressFile(const char *srcPath, const char *destPath,
+  int level, unsigned dictSize, int lc, int lp, int pb, int fb, int numThreads)
+{
+  CInFile in;
+  COutFile out;
+  CLzmaEncHandle enc;
+  SRes res;
+
+  if (srcPath == 0 || destPath == 0)
+    return SZ_ERROR_PARAM;
+  RINOK(InFile_Open(&in, srcPath));
+  res = OutFile_Open(&out, destPath, &in);
+  if (res != SZ_OK)
+  {
+    InFile_Close(&in);
+    return res;
+  }
+
+  enc = LzmaEnc_Create(&g_Alloc);
+  if (enc == 0)
+    res = SZ_ERROR_MEM;
+  else
+  {
+    res = CompressFile(enc, &in, &out, level, dictSize, lc, lp, pb, fb, numThreads);
+    LzmaEnc_Destroy(enc, &g_Alloc, &g_BigAlloc);
+  }
+  InFile_Close(&in);
+  res = OutFile_Close(&out, res);
+  if (res != SZ_OK && out.isFile)
+    remove(destPath);
+  return res;
+}
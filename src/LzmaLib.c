@@ -3,8 +3,13 @@
 Igor Pavlov
 Public domain */
 
+#include <string.h>
+
 #include "LzmaEnc.h"
 #include "LzmaDec.h"
+#include "Lzma2Enc.h"
+#include "Lzma2Dec.h"
+#include "LzScan.h"
 #include "Alloc.h"
 #include "LzmaLib.h"
 
@@ -12,6 +17,25 @@ static void *SzAlloc(void *p, size_t size) { p = p; return MyAlloc(size); }
 static void SzFree(void *p, void *address) { p = p; MyFree(address); }
 static ISzAlloc g_Alloc = { SzAlloc, SzFree };
 
+/* the match finder buffers of the encoder (allocBig) can use large pages */
+static void *SzBigAlloc(void *p, size_t size) { p = p; return BigAlloc(size); }
+static void SzBigFree(void *p, void *address) { p = p; BigFree(address); }
+static ISzAlloc g_BigAlloc = { SzBigAlloc, SzBigFree };
+
+static void SetEncProps(CLzmaEncProps *props, size_t srcLen,
+  int level, unsigned dictSize, int lc, int lp, int pb, int fb, int numThreads)
+{
+  LzmaEncProps_Init(props);
+  props->reduceSize = srcLen;
+  props->level = level;
+  props->dictSize = dictSize;
+  props->lc = lc;
+  props->lp = lp;
+  props->pb = pb;
+  props->fb = fb;
+  props->numThreads = numThreads;
+}
+
 int WINAPI LzmaCompress(unsigned char *dest, size_t  *destLen, const unsigned char *src, size_t  srcLen,
   unsigned char *outProps, size_t *outPropsSize,
   int level, /* 0 <= level <= 9, default = 5 */
@@ -20,27 +44,629 @@ int WINAPI LzmaCompress(unsigned char *dest, size_t  *destLen, const unsigned ch
   int lp, /* 0 <= lp <= 4, default = 0  */
   int pb, /* 0 <= pb <= 4, default = 2  */
   int fb,  /* 5 <= fb <= 273, default = 32 */
-  int numThreads /* 1 or 2, default = 2 */
+  int numThreads /* 1 <= numThreads <= 16, default = 2 */
 )
+{
+  return LzmaCompressEx(dest, destLen, src, srcLen, outProps, outPropsSize,
+      level, dictSize, lc, lp, pb, fb, numThreads, NULL, NULL);
+}
+
+int WINAPI LzmaCompressEx(unsigned char *dest, size_t *destLen, const unsigned char *src, size_t srcLen,
+  unsigned char *outProps, size_t *outPropsSize,
+  int level, unsigned dictSize, int lc, int lp, int pb, int fb, int numThreads,
+  ISzAlloc *alloc, ISzAlloc *allocBig)
 {
   CLzmaEncProps props;
-  LzmaEncProps_Init(&props);
-  props.level = level;
-  props.dictSize = dictSize;
-  props.lc = lc;
-  props.lp = lp;
-  props.pb = pb;
-  props.fb = fb;
-  props.numThreads = numThreads;
+  SetEncProps(&props, srcLen, level, dictSize, lc, lp, pb, fb, numThreads);
 
   return LzmaEncode(dest, destLen, src, srcLen, &props, outProps, outPropsSize, 0,
-      NULL, &g_Alloc, &g_Alloc);
+      NULL, alloc ? alloc : &g_Alloc, allocBig ? allocBig : &g_BigAlloc);
+}
+
+LzmaEncoderContext WINAPI LzmaEncoderContext_Create(void)
+{
+  return LzmaEnc_Create(&g_Alloc);
+}
+
+void WINAPI LzmaEncoderContext_Destroy(LzmaEncoderContext ctx)
+{
+  if (ctx != 0)
+    LzmaEnc_Destroy(ctx, &g_Alloc, &g_BigAlloc);
+}
+
+void WINAPI LzmaEncoderContext_SetMemLimit(LzmaEncoderContext ctx, UInt64 memLimit)
+{
+  if (ctx != 0)
+    LzmaEnc_SetMemLimit(ctx, memLimit);
+}
+
+UInt64 WINAPI LzmaCompressMemUsage(size_t srcLen,
+  int level, unsigned dictSize, int lc, int lp, int pb, int fb, int numThreads)
+{
+  CLzmaEncProps props;
+  SetEncProps(&props, srcLen, level, dictSize, lc, lp, pb, fb, numThreads);
+  return LzmaEnc_EstimateMemory(&props, 1);
+}
+
+int WINAPI LzmaCompressWithContext(LzmaEncoderContext ctx,
+  unsigned char *dest, size_t *destLen, const unsigned char *src, size_t srcLen,
+  unsigned char *outProps, size_t *outPropsSize,
+  int level, unsigned dictSize, int lc, int lp, int pb, int fb, int numThreads)
+{
+  CLzmaEncProps props;
+  if (ctx == 0)
+    return LzmaCompress(dest, destLen, src, srcLen, outProps, outPropsSize,
+        level, dictSize, lc, lp, pb, fb, numThreads);
+
+  SetEncProps(&props, srcLen, level, dictSize, lc, lp, pb, fb, numThreads);
+  RINOK(LzmaEnc_SetProps(ctx, &props));
+  RINOK(LzmaEnc_WriteProperties(ctx, outProps, outPropsSize));
+  return LzmaEnc_MemEncode(ctx, dest, destLen, src, srcLen, 0, NULL, &g_Alloc, &g_BigAlloc);
+}
+
+int WINAPI LzmaCompressStreamBegin(LzmaEncoderContext ctx,
+  ISeqOutStream *outStream, ISeqInStream *inStream,
+  unsigned char *outProps, size_t *outPropsSize,
+  int level, unsigned dictSize, int lc, int lp, int pb, int fb)
+{
+  CLzmaEncProps props;
+  if (ctx == 0)
+    return SZ_ERROR_PARAM;
+  SetEncProps(&props, 0, level, dictSize, lc, lp, pb, fb, 1);
+  props.reduceSize = (UInt64)(Int64)-1;
+  props.writeEndMark = 1;
+  props.ringWindow = 1;
+  RINOK(LzmaEnc_SetProps(ctx, &props));
+  /* the memory limit for the window can reduce the dictionary in LzmaEnc_StreamPrepare */
+  RINOK(LzmaEnc_StreamPrepare(ctx, outStream, inStream, &g_Alloc, &g_BigAlloc));
+  return LzmaEnc_WriteProperties(ctx, outProps, outPropsSize);
+}
+
+int WINAPI LzmaCompressStreamCode(LzmaEncoderContext ctx, UInt64 inSize, int finish)
+{
+  if (ctx == 0)
+    return SZ_ERROR_PARAM;
+  return LzmaEnc_StreamCode(ctx, inSize, finish ? True : False);
 }
 
+int WINAPI LzmaCompressWithDict(LzmaEncoderContext ctx,
+  unsigned char *dest, size_t *destLen, const unsigned char *src, size_t srcLen,
+  const unsigned char *dict, size_t dictLen,
+  unsigned char *outProps, size_t *outPropsSize,
+  int level, unsigned dictSize, int lc, int lp, int pb, int fb, int numThreads)
+{
+  CLzmaEncProps props;
+  CLzmaEncHandle enc = ctx;
+  SRes res;
+
+  SetEncProps(&props, srcLen, level, dictSize, lc, lp, pb, fb, numThreads);
+  props.reduceSize = (UInt64)srcLen + dictLen;
+  if (enc == 0)
+  {
+    enc = LzmaEnc_Create(&g_Alloc);
+    if (enc == 0)
+      return SZ_ERROR_MEM;
+  }
+  res = LzmaEnc_SetProps(enc, &props);
+  /* the memory limit for the buffer can reduce the dictionary in LzmaEnc_MemEncodeWithDict */
+  if (res == SZ_OK)
+    res = LzmaEnc_MemEncodeWithDict(enc, dest, destLen, src, srcLen, dict, dictLen,
+        0, NULL, &g_Alloc, &g_BigAlloc);
+  if (res == SZ_OK)
+    res = LzmaEnc_WriteProperties(enc, outProps, outPropsSize);
+  if (ctx == 0)
+    LzmaEnc_Destroy(enc, &g_Alloc, &g_BigAlloc);
+  return res;
+}
+
+size_t WINAPI LzmaModelSize(int lc, int lp)
+{
+  if (lc < 0 || lc > 8 || lp < 0 || lp > 4)
+    return 0;
+  return LZMA_MODEL_HEADER_SIZE + LZMA_MODEL_NUM_PROBS(lc, lp) * sizeof(UInt16);
+}
+
+#define GetUi32(p) ((UInt32)(p)[0] | ((UInt32)(p)[1] << 8) | ((UInt32)(p)[2] << 16) | ((UInt32)(p)[3] << 24))
+
+static void SetUi32(Byte *p, UInt32 v)
+{
+  p[0] = (Byte)v;
+  p[1] = (Byte)(v >> 8);
+  p[2] = (Byte)(v >> 16);
+  p[3] = (Byte)(v >> 24);
+}
+
+static SRes CheckModel(const unsigned char *model, size_t modelSize)
+{
+  unsigned d;
+  if (modelSize < LZMA_MODEL_HEADER_SIZE
+      || model[0] != 'L' || model[1] != 'Z' || model[2] != 'M' || model[3] != 'P')
+    return SZ_ERROR_DATA;
+  d = model[8];
+  if (d >= 9 * 5 * 5 || modelSize != LzmaModelSize(d % 9, (d / 9) % 5))
+    return SZ_ERROR_DATA;
+  return SZ_OK;
+}
+
+int WINAPI LzmaModelGetId(const unsigned char *model, size_t modelSize, unsigned *modelId)
+{
+  RINOK(CheckModel(model, modelSize));
+  *modelId = GetUi32(model + 4);
+  return SZ_OK;
+}
+
+/* the loaded model: the probabilities follow the structure */
+
+typedef struct
+{
+  UInt32 id;
+  Byte lcLpPb;
+} CLzmaModel;
+
+#define MODEL_PROBS(m) ((UInt16 *)((CLzmaModel *)(m) + 1))
+
+/* the probabilities of the model are little-endian and unaligned in (model) */
+
+int WINAPI LzmaModelLoad(LzmaModel *handle, const unsigned char *model, size_t modelSize)
+{
+  CLzmaModel *m;
+  UInt16 *probs;
+  UInt32 numProbs, i;
+  *handle = 0;
+  RINOK(CheckModel(model, modelSize));
+  numProbs = (UInt32)((modelSize - LZMA_MODEL_HEADER_SIZE) / 2);
+  m = (CLzmaModel *)MyAlloc(sizeof(CLzmaModel) + numProbs * sizeof(UInt16));
+  if (m == 0)
+    return SZ_ERROR_MEM;
+  m->id = GetUi32(model + 4);
+  m->lcLpPb = model[8];
+  probs = MODEL_PROBS(m);
+  model += LZMA_MODEL_HEADER_SIZE;
+  for (i = 0; i < numProbs; i++, model += 2)
+  {
+    UInt16 v = (UInt16)(model[0] | ((UInt16)model[1] << 8));
+    /* the range coder requires (0 < prob < kBitModelTotal) */
+    if (v == 0 || v >= (1 << 11))
+    {
+      MyFree(m);
+      return SZ_ERROR_DATA;
+    }
+    probs[i] = v;
+  }
+  *handle = m;
+  return SZ_OK;
+}
+
+void WINAPI LzmaModelFree(LzmaModel handle)
+{
+  MyFree(handle);
+}
+
+int WINAPI LzmaCompressWithModel(LzmaEncoderContext ctx,
+  unsigned char *dest, size_t *destLen, const unsigned char *src, size_t srcLen,
+  LzmaModel model, unsigned char *outProps, size_t *outPropsSize,
+  int level, unsigned dictSize, int fb, int numThreads)
+{
+  const CLzmaModel *m = (const CLzmaModel *)model;
+  CLzmaEncProps props;
+  CLzmaEncHandle enc = ctx;
+  unsigned d;
+  SRes res;
+
+  if (m == 0 || *outPropsSize < LZMA_MODEL_PROPS_SIZE)
+    return SZ_ERROR_PARAM;
+  d = m->lcLpPb;
+  SetEncProps(&props, srcLen, level, dictSize, d % 9, (d / 9) % 5, d / 45, fb, numThreads);
+  if (enc == 0)
+    enc = LzmaEnc_Create(&g_Alloc);
+  if (enc == 0)
+    return SZ_ERROR_MEM;
+  res = LzmaEnc_SetProps(enc, &props);
+  if (res == SZ_OK)
+    res = LzmaEnc_WriteProperties(enc, outProps, outPropsSize);
+  if (res == SZ_OK)
+  {
+    SetUi32(outProps + LZMA_PROPS_SIZE, m->id);
+    *outPropsSize = LZMA_MODEL_PROPS_SIZE;
+    LzmaEnc_SetModel(enc, MODEL_PROBS(m));
+    res = LzmaEnc_MemEncode(enc, dest, destLen, src, srcLen, 0, NULL, &g_Alloc, &g_BigAlloc);
+    LzmaEnc_SetModel(enc, NULL);
+  }
+  if (ctx == 0)
+    LzmaEnc_Destroy(enc, &g_Alloc, &g_BigAlloc);
+  return res;
+}
+
+int WINAPI LzmaSetLargePages(int enable)
+{
+  return BigAlloc_SetLargePages(enable);
+}
+
+int WINAPI LzmaEncoderContext_GetPages(LzmaEncoderContext ctx, size_t *pageSize)
+{
+  const void *buf = LzmaEnc_GetMatchFinderBuf((CLzmaEncHandle)ctx);
+  if (buf == 0)
+  {
+    *pageSize = 0;
+    return -1;
+  }
+  return BigAlloc_GetPages(buf, pageSize);
+}
+
+size_t WINAPI LzmaCompressBound(size_t srcLen)
+{
+  size_t bound = srcLen + srcLen / 3 + 128;
+  return (bound < srcLen) ? 0 : bound;
+}
+
+int WINAPI LzmaIsIncompressible(const unsigned char *src, size_t srcLen)
+{
+  return LzScan_IsIncompressible(src, srcLen) ? 1 : 0;
+}
+
+int WINAPI Lzma2Compress(unsigned char *dest, size_t *destLen, const unsigned char *src, size_t srcLen,
+  unsigned char *outProp,
+  int level, unsigned dictSize, int lc, int lp, int pb, int fb, int numThreads,
+  size_t blockSize)
+{
+  CLzma2EncProps props;
+  CLzma2EncHandle enc;
+  SRes res;
+
+  Lzma2EncProps_Init(&props);
+  SetEncProps(&props.lzmaProps, srcLen, level, dictSize, lc, lp, pb, fb, numThreads);
+  props.blockSize = blockSize;
+
+  enc = Lzma2Enc_Create(&g_Alloc, &g_BigAlloc);
+  if (enc == 0)
+    return SZ_ERROR_MEM;
+  res = Lzma2Enc_SetProps(enc, &props);
+  if (res == SZ_OK)
+  {
+    *outProp = Lzma2Enc_WriteProperties(enc);
+    res = Lzma2Enc_MemEncode(enc, dest, destLen, src, srcLen, NULL);
+  }
+  Lzma2Enc_Destroy(enc);
+  return res;
+}
+
+int WINAPI Lzma2Uncompress(unsigned char *dest, size_t *destLen, const unsigned char *src, SizeT *srcLen,
+  unsigned char prop)
+{
+  ELzmaStatus status;
+  return Lzma2Decode(dest, destLen, src, srcLen, prop, LZMA_FINISH_ANY, &status, &g_Alloc);
+}
 
 int WINAPI LzmaUncompress(unsigned char *dest, size_t  *destLen, const unsigned char *src, size_t  *srcLen,
   const unsigned char *props, size_t propsSize)
 {
+  return LzmaUncompressEx(dest, destLen, src, srcLen, props, propsSize, NULL);
+}
+
+int WINAPI LzmaUncompressEx(unsigned char *dest, size_t *destLen, const unsigned char *src, SizeT *srcLen,
+  const unsigned char *props, size_t propsSize, ISzAlloc *alloc)
+{
+  ELzmaStatus status;
+  return LzmaDecode(dest, destLen, src, srcLen, props, (unsigned)propsSize, LZMA_FINISH_ANY, &status,
+      alloc ? alloc : &g_Alloc);
+}
+
+/* The other functions use the context as CLzmaDec with the output buffer as the
+   dictionary. The stream decoder has its own dictionary, it's kept for the next streams. */
+
+typedef struct
+{
+  CLzmaDec dec; /* must be first */
+  Byte *dic;
+  SizeT dicSize;
+  Byte *presetBuf;  /* the preset dictionary and the output of LzmaUncompressWithDict */
+  SizeT presetBufSize;
+} CDecoderContext;
+
+LzmaDecoderContext WINAPI LzmaDecoderContext_Create(void)
+{
+  CDecoderContext *p = (CDecoderContext *)g_Alloc.Alloc(&g_Alloc, sizeof(CDecoderContext));
+  if (p != 0)
+  {
+    LzmaDec_Construct(&p->dec);
+    p->dic = 0;
+    p->dicSize = 0;
+    p->presetBuf = 0;
+    p->presetBufSize = 0;
+  }
+  return p;
+}
+
+void WINAPI LzmaDecoderContext_Destroy(LzmaDecoderContext ctx)
+{
+  if (ctx != 0)
+  {
+    LzmaDec_FreeProbs((CLzmaDec *)ctx, &g_Alloc);
+    g_Alloc.Free(&g_Alloc, ((CDecoderContext *)ctx)->dic);
+    g_Alloc.Free(&g_Alloc, ((CDecoderContext *)ctx)->presetBuf);
+    g_Alloc.Free(&g_Alloc, ctx);
+  }
+}
+
+void WINAPI LzmaDecoderContext_SetMemLimit(LzmaDecoderContext ctx, UInt64 memLimit)
+{
+  if (ctx != 0)
+    ((CLzmaDec *)ctx)->memLimit = memLimit;
+}
+
+UInt64 WINAPI LzmaUncompressMemUsage(const unsigned char *props, size_t propsSize)
+{
+  CLzmaProps p;
+  if (LzmaProps_Decode(&p, props, (unsigned)propsSize) != SZ_OK)
+    return 0;
+  return LzmaDec_EstimateMemory(&p);
+}
+
+int WINAPI LzmaUncompressWithContext(LzmaDecoderContext ctx,
+  unsigned char *dest, size_t *destLen, const unsigned char *src, SizeT *srcLen,
+  const unsigned char *props, size_t propsSize)
+{
+  ELzmaStatus status;
+  if (ctx == 0)
+    return LzmaUncompress(dest, destLen, src, srcLen, props, propsSize);
+  return LzmaDec_DecodeOneCall((CLzmaDec *)ctx, dest, destLen, src, srcLen,
+      props, (unsigned)propsSize, LZMA_FINISH_ANY, &status, &g_Alloc);
+}
+
+int WINAPI LzmaUncompressStreamBegin(LzmaDecoderContext ctx, const unsigned char *props, size_t propsSize)
+{
+  CDecoderContext *c = (CDecoderContext *)ctx;
+  CLzmaProps prop;
+  if (c == 0)
+    return SZ_ERROR_PARAM;
+  RINOK(LzmaProps_Decode(&prop, props, (unsigned)propsSize));
+  if (c->dec.memLimit != 0 && LzmaDec_EstimateMemory(&prop) > c->dec.memLimit)
+    return SZ_ERROR_MEM;
+  RINOK(LzmaDec_AllocateProbs(&c->dec, props, (unsigned)propsSize, &g_Alloc));
+  if (c->dic == 0 || c->dicSize != prop.dicSize)
+  {
+    g_Alloc.Free(&g_Alloc, c->dic);
+    c->dicSize = 0;
+    c->dic = (Byte *)g_Alloc.Alloc(&g_Alloc, prop.dicSize);
+    if (c->dic == 0)
+      return SZ_ERROR_MEM;
+    c->dicSize = prop.dicSize;
+  }
+  c->dec.dic = c->dic;
+  c->dec.dicBufSize = c->dicSize;
+  LzmaDec_Init(&c->dec);
+  return SZ_OK;
+}
+
+int WINAPI LzmaUncompressStreamCode(LzmaDecoderContext ctx,
+  unsigned char *dest, size_t *destLen, const unsigned char *src, SizeT *srcLen, ELzmaStatus *status)
+{
+  CDecoderContext *c = (CDecoderContext *)ctx;
+  /* another call with ctx has reset the decoder */
+  if (c == 0 || c->dic == 0 || c->dec.dic != c->dic)
+  {
+    *destLen = *srcLen = 0;
+    *status = LZMA_STATUS_NOT_SPECIFIED;
+    return SZ_ERROR_PARAM;
+  }
+  return LzmaDec_DecodeToBuf(&c->dec, dest, destLen, src, srcLen, LZMA_FINISH_ANY, status);
+}
+
+/* The preset and the output must be in one buffer, because matches can cross the border.
+   (*buf, *bufSize) is kept by the caller for the next calls, it only grows. */
+
+static SRes UncompressWithDict(CLzmaDec *p, Byte **buf, SizeT *bufSize,
+  unsigned char *dest, size_t *destLen, const unsigned char *src, SizeT *srcLen,
+  const unsigned char *dict, size_t dictLen, const unsigned char *props, size_t propsSize)
+{
+  SRes res;
+  SizeT inSize = *srcLen;
+  SizeT outSize = *destLen;
+  SizeT presetSize = dictLen;
+  ELzmaStatus status;
+  *destLen = *srcLen = 0;
+
+  RINOK(LzmaDec_AllocateProbs(p, props, (unsigned)propsSize, &g_Alloc));
+  if (presetSize > p->prop.dicSize)
+    presetSize = p->prop.dicSize;
+  if (outSize >= (SizeT)0 - 1 - presetSize)
+    return SZ_ERROR_MEM;
+  if (p->memLimit != 0 &&
+      (UInt64)p->numProbs * sizeof(CLzmaProb) + presetSize + outSize + 1 > p->memLimit)
+    return SZ_ERROR_MEM;
+  if (*bufSize < presetSize + outSize + 1)
+  {
+    g_Alloc.Free(&g_Alloc, *buf);
+    *bufSize = 0;
+    *buf = (Byte *)g_Alloc.Alloc(&g_Alloc, presetSize + outSize + 1);
+    if (*buf == 0)
+      return SZ_ERROR_MEM;
+    *bufSize = presetSize + outSize + 1;
+  }
+  p->dic = *buf;
+  p->dicBufSize = presetSize + outSize;
+  LzmaDec_Init(p);
+  res = LzmaDec_SetPresetDict(p, dict, dictLen);
+  if (res == SZ_OK)
+  {
+    *srcLen = inSize;
+    res = LzmaDec_DecodeToDic(p, p->dicBufSize, src, srcLen, LZMA_FINISH_ANY, &status);
+    if (res == SZ_OK && status == LZMA_STATUS_NEEDS_MORE_INPUT)
+      res = SZ_ERROR_INPUT_EOF;
+    *destLen = p->dicPos - presetSize;
+    memcpy(dest, p->dic + presetSize, *destLen);
+  }
+  p->dic = 0;
+  return res;
+}
+
+int WINAPI LzmaUncompressWithDict(LzmaDecoderContext ctx,
+  unsigned char *dest, size_t *destLen, const unsigned char *src, SizeT *srcLen,
+  const unsigned char *dict, size_t dictLen, const unsigned char *props, size_t propsSize)
+{
+  CLzmaDec p;
+  Byte *buf = 0;
+  SizeT bufSize = 0;
+  SRes res;
+  if (ctx != 0)
+  {
+    CDecoderContext *c = (CDecoderContext *)ctx;
+    return UncompressWithDict(&c->dec, &c->presetBuf, &c->presetBufSize,
+        dest, destLen, src, srcLen, dict, dictLen, props, propsSize);
+  }
+  LzmaDec_Construct(&p);
+  res = UncompressWithDict(&p, &buf, &bufSize, dest, destLen, src, srcLen, dict, dictLen, props, propsSize);
+  LzmaDec_FreeProbs(&p, &g_Alloc);
+  g_Alloc.Free(&g_Alloc, buf);
+  return res;
+}
+
+static SRes UncompressWithModel(CLzmaDec *p,
+  unsigned char *dest, size_t *destLen, const unsigned char *src, SizeT *srcLen,
+  const UInt16 *probs, const unsigned char *props, size_t propsSize)
+{
+  SRes res;
+  SizeT inSize = *srcLen;
   ELzmaStatus status;
-  return LzmaDecode(dest, destLen, src, srcLen, props, (unsigned)propsSize, LZMA_FINISH_ANY, &status, &g_Alloc);
+  *srcLen = 0;
+
+  RINOK(LzmaDec_AllocateProbs(p, props, (unsigned)propsSize, &g_Alloc));
+  p->dic = dest;
+  p->dicBufSize = *destLen;
+  *destLen = 0;
+  LzmaDec_Init(p);
+  LzmaDec_InitModel(p, probs);
+
+  *srcLen = inSize;
+  res = LzmaDec_DecodeToDic(p, p->dicBufSize, src, srcLen, LZMA_FINISH_ANY, &status);
+  if (res == SZ_OK && status == LZMA_STATUS_NEEDS_MORE_INPUT)
+    res = SZ_ERROR_INPUT_EOF;
+  *destLen = p->dicPos;
+  p->dic = 0;
+  return res;
+}
+
+int WINAPI LzmaUncompressWithModel(LzmaDecoderContext ctx,
+  unsigned char *dest, size_t *destLen, const unsigned char *src, SizeT *srcLen,
+  LzmaModel model, const unsigned char *props, size_t propsSize)
+{
+  const CLzmaModel *m = (const CLzmaModel *)model;
+  CLzmaDec p;
+  SRes res;
+
+  if (m == 0)
+    return SZ_ERROR_PARAM;
+  /* the stream of another model can't be decoded correctly */
+  if (propsSize < LZMA_MODEL_PROPS_SIZE || props[0] != m->lcLpPb || GetUi32(props + LZMA_PROPS_SIZE) != m->id)
+    return SZ_ERROR_DATA;
+  if (ctx != 0)
+    return UncompressWithModel((CLzmaDec *)ctx, dest, destLen, src, srcLen, MODEL_PROBS(m),
+        props, LZMA_PROPS_SIZE);
+  LzmaDec_Construct(&p);
+  res = UncompressWithModel(&p, dest, destLen, src, srcLen, MODEL_PROBS(m), props, LZMA_PROPS_SIZE);
+  LzmaDec_FreeProbs(&p, &g_Alloc);
+  return res;
+}
+
+#define LZMA_OUT_BUF_MIN (1 << 16)
+
+static SRes UncompressToBuf(CLzmaDec *p, ILzmaOutBuf *outBuf, size_t sizeHint, size_t *destLen,
+  const unsigned char *src, SizeT *srcLen, const unsigned char *props, size_t propsSize,
+  ELzmaStatus *status, ISzAlloc *alloc)
+{
+  SRes res;
+  SizeT inSize = *srcLen;
+  SizeT inPos = 0;
+  SizeT bufSize = sizeHint;
+  *destLen = *srcLen = 0;
+  *status = LZMA_STATUS_NOT_SPECIFIED;
+
+  if (bufSize == 0)
+  {
+    bufSize = inSize * 4;
+    if (bufSize / 4 != inSize || bufSize < LZMA_OUT_BUF_MIN)
+      bufSize = LZMA_OUT_BUF_MIN;
+  }
+
+  RINOK(LzmaDec_AllocateProbs(p, props, (unsigned)propsSize, alloc));
+  LzmaDec_Init(p);
+  p->dic = outBuf->Resize(outBuf, bufSize);
+  p->dicBufSize = bufSize;
+  res = (p->dic == 0) ? SZ_ERROR_MEM : SZ_OK;
+
+  while (res == SZ_OK)
+  {
+    SizeT inProcessed = inSize - inPos;
+    res = LzmaDec_DecodeToDic(p, p->dicBufSize, src + inPos, &inProcessed, LZMA_FINISH_ANY, status);
+    inPos += inProcessed;
+    if (res != SZ_OK || *status == LZMA_STATUS_FINISHED_WITH_MARK)
+      break;
+    if (inPos == inSize && p->needFlush == 0 && p->tempBufSize == 0 &&
+        p->remainLen == 0 && p->code == 0 &&
+        (*status == LZMA_STATUS_NEEDS_MORE_INPUT || *status == LZMA_STATUS_MAYBE_FINISHED_WITHOUT_MARK))
+    {
+      *status = LZMA_STATUS_MAYBE_FINISHED_WITHOUT_MARK;
+      break;
+    }
+    if (*status == LZMA_STATUS_NEEDS_MORE_INPUT)
+    {
+      res = SZ_ERROR_INPUT_EOF;
+      break;
+    }
+
+    /* the output is full: grow the buffer and continue from the same point */
+    bufSize = p->dicBufSize >> 1;
+    if (bufSize < LZMA_OUT_BUF_MIN)
+      bufSize = LZMA_OUT_BUF_MIN;
+    bufSize += p->dicBufSize;
+    if (bufSize < p->dicBufSize)
+    {
+      res = SZ_ERROR_MEM;
+      break;
+    }
+    p->dic = outBuf->Resize(outBuf, bufSize);
+    if (p->dic == 0)
+    {
+      res = SZ_ERROR_MEM;
+      break;
+    }
+    p->dicBufSize = bufSize;
+  }
+
+  *destLen = p->dicPos;
+  *srcLen = inPos;
+  p->dic = 0;
+  return res;
+}
+
+int WINAPI LzmaUncompressToBuf(ILzmaOutBuf *outBuf, size_t sizeHint, size_t *destLen,
+  const unsigned char *src, SizeT *srcLen, const unsigned char *props, size_t propsSize,
+  ELzmaStatus *status)
+{
+  return LzmaUncompressToBufEx(outBuf, sizeHint, destLen, src, srcLen, props, propsSize, status, NULL);
+}
+
+int WINAPI LzmaUncompressToBufEx(ILzmaOutBuf *outBuf, size_t sizeHint, size_t *destLen,
+  const unsigned char *src, SizeT *srcLen, const unsigned char *props, size_t propsSize,
+  ELzmaStatus *status, ISzAlloc *alloc)
+{
+  CLzmaDec p;
+  SRes res;
+  if (alloc == 0)
+    alloc = &g_Alloc;
+  LzmaDec_Construct(&p);
+  res = UncompressToBuf(&p, outBuf, sizeHint, destLen, src, srcLen, props, propsSize, status, alloc);
+  LzmaDec_FreeProbs(&p, alloc);
+  return res;
+}
+
+int WINAPI LzmaUncompressToBufWithContext(LzmaDecoderContext ctx,
+  ILzmaOutBuf *outBuf, size_t sizeHint, size_t *destLen,
+  const unsigned char *src, SizeT *srcLen, const unsigned char *props, size_t propsSize,
+  ELzmaStatus *status)
+{
+  if (ctx == 0)
+    return LzmaUncompressToBuf(outBuf, sizeHint, destLen, src, srcLen, props, propsSize, status);
+  return UncompressToBuf((CLzmaDec *)ctx, outBuf, sizeHint, destLen, src, srcLen, props, propsSize, status,
+      &g_Alloc);
 }
@@ -0,0 +1,442 @@
+/* LzmaLibMt.c -- Block-parallel LZMA library functions
+2026-10-17 : Public domain */
+
+#include <string.h>
+
+#include "Alloc.h"
+#include "LzmaLib.h"
+
+#ifndef _7ZIP_ST
+#include "Threads.h"
+#endif
+
+#define LZMA_MT_BLOCK_HEADER_SIZE (LZMA_PROPS_SIZE + 8)
+#define LZMA_MT_INDEX_ITEM_SIZE 8
+#define LZMA_MT_FOOTER_SIZE 16
+#define LZMA_MT_BLOCK_SIZE_DEFAULT ((size_t)1 << 24)
+#define LZMA_MT_BLOCK_SIZE_MIN ((size_t)1 << 16)
+#define LZMA_MT_BLOCK_SIZE_MAX ((size_t)1 << 30)
+#define LZMA_MT_THREADS_DEFAULT 2
+#define LZMA_MT_THREADS_MAX 64
+
+static const Byte kMtSignature[4] = { 'L', 'Z', 'M', 'X' };
+
+static void SetUi32(Byte *p, UInt32 v)
+{
+  p[0] = (Byte)v;
+  p[1] = (Byte)(v >> 8);
+  p[2] = (Byte)(v >> 16);
+  p[3] = (Byte)(v >> 24);
+}
+
+static UInt32 GetUi32(const Byte *p)
+{
+  return p[0] | ((UInt32)p[1] << 8) | ((UInt32)p[2] << 16) | ((UInt32)p[3] << 24);
+}
+
+/* ---------- Thread pool ---------- */
+
+/* LzmaMt_Run calls func(obj, threadIndex, blockIndex) for each block in [0, numBlocks).
+   Blocks are taken in order by (numThreads) threads; the calling thread is thread 0.
+   After the first error no new blocks are started, and the first error code is returned. */
+
+typedef SRes (*LzmaMt_BlockFunc)(void *obj, unsigned threadIndex, UInt32 blockIndex);
+
+typedef struct
+{
+  LzmaMt_BlockFunc func;
+  void *obj;
+  UInt32 numBlocks;
+  UInt32 nextBlock;
+  SRes res;
+  #ifndef _7ZIP_ST
+  CCriticalSection cs;
+  #endif
+} CLzmaMtJob;
+
+#ifdef _7ZIP_ST
+#define LzmaMtJob_Lock(p)
+#define LzmaMtJob_Unlock(p)
+#else
+#define LzmaMtJob_Lock(p) CriticalSection_Enter(&(p)->cs)
+#define LzmaMtJob_Unlock(p) CriticalSection_Leave(&(p)->cs)
+#endif
+
+static void LzmaMtJob_Process(CLzmaMtJob *p, unsigned threadIndex)
+{
+  for (;;)
+  {
+    UInt32 blockIndex;
+    SRes res;
+    LzmaMtJob_Lock(p);
+    blockIndex = p->nextBlock;
+    if (p->res != SZ_OK)
+      blockIndex = p->numBlocks;
+    else if (blockIndex != p->numBlocks)
+      p->nextBlock++;
+    LzmaMtJob_Unlock(p);
+    if (blockIndex == p->numBlocks)
+      return;
+    res = p->func(p->obj, threadIndex, blockIndex);
+    if (res != SZ_OK)
+    {
+      LzmaMtJob_Lock(p);
+      if (p->res == SZ_OK)
+        p->res = res;
+      LzmaMtJob_Unlock(p);
+    }
+  }
+}
+
+#ifndef _7ZIP_ST
+
+typedef struct
+{
+  CLzmaMtJob *job;
+  unsigned index;
+  CThread thread;
+} CLzmaMtThread;
+
+static THREAD_FUNC_DECL LzmaMt_ThreadFunc(void *pp)
+{
+  CLzmaMtThread *p = (CLzmaMtThread *)pp;
+  LzmaMtJob_Process(p->job, p->index);
+  return 0;
+}
+
+#endif
+
+static SRes LzmaMt_Run(LzmaMt_BlockFunc func, void *obj, UInt32 numBlocks, unsigned numThreads)
+{
+  CLzmaMtJob job;
+  job.func = func;
+  job.obj = obj;
+  job.numBlocks = numBlocks;
+  job.nextBlock = 0;
+  job.res = SZ_OK;
+
+  #ifndef _7ZIP_ST
+  {
+    CLzmaMtThread threads[LZMA_MT_THREADS_MAX];
+    unsigned i, numCreated;
+    if (numThreads > numBlocks)
+      numThreads = numBlocks;
+    if (CriticalSection_Init(&job.cs) != 0)
+      return SZ_ERROR_THREAD;
+    /* if some thread can't be created, the remaining threads do its work */
+    for (numCreated = 1; numCreated < numThreads; numCreated++)
+    {
+      CLzmaMtThread *t = &threads[numCreated];
+      t->job = &job;
+      t->index = numCreated;
+      Thread_Construct(&t->thread);
+      if (Thread_Create(&t->thread, LzmaMt_ThreadFunc, t) != 0)
+        break;
+    }
+    LzmaMtJob_Process(&job, 0);
+    for (i = 1; i < numCreated; i++)
+    {
+      Thread_Wait(&threads[i].thread);
+      Thread_Close(&threads[i].thread);
+    }
+    CriticalSection_Delete(&job.cs);
+  }
+  #else
+  numThreads = numThreads;
+  LzmaMtJob_Process(&job, 0);
+  #endif
+  return job.res;
+}
+
+static unsigned LzmaMt_GetNumThreads(int numThreads)
+{
+  if (numThreads < 0)
+    return LZMA_MT_THREADS_DEFAULT;
+  if (numThreads == 0)
+    return 1;
+  if (numThreads > LZMA_MT_THREADS_MAX)
+    return LZMA_MT_THREADS_MAX;
+  return (unsigned)numThreads;
+}
+
+/* ---------- Encoder ---------- */
+
+typedef struct
+{
+  Byte *dest;
+  size_t slotSize;
+  const Byte *src;
+  size_t srcLen;
+  size_t blockSize;
+  int level;
+  unsigned dictSize;
+  int lc, lp, pb, fb;
+  int numThreads;
+  LzmaEncoderContext ctx[LZMA_MT_THREADS_MAX];
+} CLzmaMtEnc;
+
+/* Block (blockIndex) is written to its own slot of the worst-case size,
+   the slots are joined after all blocks are written. */
+
+static SRes LzmaMtEnc_Block(void *pp, unsigned threadIndex, UInt32 blockIndex)
+{
+  CLzmaMtEnc *p = (CLzmaMtEnc *)pp;
+  Byte *dest = p->dest + (size_t)blockIndex * p->slotSize;
+  size_t pos = (size_t)blockIndex * p->blockSize;
+  size_t srcLen = p->srcLen - pos;
+  size_t packSize = p->slotSize - LZMA_MT_BLOCK_HEADER_SIZE;
+  size_t propsSize = LZMA_PROPS_SIZE;
+  if (srcLen > p->blockSize)
+    srcLen = p->blockSize;
+  if (!LzmaIsIncompressible(p->src + pos, srcLen))
+  {
+    if (p->ctx[threadIndex] == 0)
+    {
+      p->ctx[threadIndex] = LzmaEncoderContext_Create();
+      if (p->ctx[threadIndex] == 0)
+        return SZ_ERROR_MEM;
+    }
+    RINOK(LzmaCompressWithContext(p->ctx[threadIndex],
+        dest + LZMA_MT_BLOCK_HEADER_SIZE, &packSize, p->src + pos, srcLen, dest, &propsSize,
+        p->level, p->dictSize, p->lc, p->lp, p->pb, p->fb, p->numThreads));
+  }
+  else
+    packSize = srcLen;
+  if (packSize >= srcLen)
+  {
+    /* the slot is not smaller than LzmaCompressBound(srcLen) >= srcLen */
+    memset(dest, 0, LZMA_PROPS_SIZE);
+    dest[0] = LZMA_PROPS_STORED;
+    memcpy(dest + LZMA_MT_BLOCK_HEADER_SIZE, p->src + pos, srcLen);
+    packSize = srcLen;
+  }
+  SetUi32(dest + LZMA_PROPS_SIZE, (UInt32)packSize);
+  SetUi32(dest + LZMA_PROPS_SIZE + 4, (UInt32)srcLen);
+  return SZ_OK;
+}
+
+static size_t LzmaMt_GetBlockSize(size_t blockSize)
+{
+  return (blockSize == 0) ? LZMA_MT_BLOCK_SIZE_DEFAULT : blockSize;
+}
+
+size_t WINAPI LzmaCompressMtBound(size_t srcLen, size_t blockSize)
+{
+  size_t numBlocks, slotSize, bound;
+  blockSize = LzmaMt_GetBlockSize(blockSize);
+  if (blockSize < LZMA_MT_BLOCK_SIZE_MIN || blockSize > LZMA_MT_BLOCK_SIZE_MAX
+      || srcLen > (size_t)0 - blockSize)
+    return 0;
+  numBlocks = (srcLen + blockSize - 1) / blockSize;
+  if ((UInt64)numBlocks > (UInt32)0xFFFFFFFF)
+    return 0;
+  if (numBlocks == 0)
+    return LZMA_MT_FOOTER_SIZE;
+  /* all slots have the size for (blockSize) except the last one */
+  slotSize = LZMA_MT_BLOCK_HEADER_SIZE + LzmaCompressBound(blockSize) + LZMA_MT_INDEX_ITEM_SIZE;
+  bound = LZMA_MT_FOOTER_SIZE + LZMA_MT_BLOCK_HEADER_SIZE + LZMA_MT_INDEX_ITEM_SIZE
+      + LzmaCompressBound(srcLen - (numBlocks - 1) * blockSize);
+  if (numBlocks - 1 > ((size_t)0 - 1 - bound) / slotSize)
+    return 0;
+  return bound + (numBlocks - 1) * slotSize;
+}
+
+int WINAPI LzmaCompressMt(unsigned char *dest, size_t *destLen, const unsigned char *src, size_t srcLen,
+  int level, unsigned dictSize, int lc, int lp, int pb, int fb, int numThreads,
+  size_t blockSize, int numBlockThreads)
+{
+  CLzmaMtEnc p;
+  UInt32 numBlocks, i;
+  size_t bound = LzmaCompressMtBound(srcLen, blockSize);
+  size_t outPos, blockPos;
+  SRes res;
+
+  if (bound == 0)
+    return SZ_ERROR_PARAM;
+  if (*destLen < bound)
+  {
+    *destLen = 0;
+    return SZ_ERROR_OUTPUT_EOF;
+  }
+
+  p.blockSize = LzmaMt_GetBlockSize(blockSize);
+  numBlocks = (UInt32)((srcLen + p.blockSize - 1) / p.blockSize);
+  p.dest = dest;
+  p.slotSize = LZMA_MT_BLOCK_HEADER_SIZE + LzmaCompressBound(p.blockSize);
+  p.src = src;
+  p.srcLen = srcLen;
+  p.level = level;
+  p.dictSize = dictSize;
+  p.lc = lc;
+  p.lp = lp;
+  p.pb = pb;
+  p.fb = fb;
+  p.numThreads = numThreads;
+  memset(p.ctx, 0, sizeof(p.ctx));
+
+  res = LzmaMt_Run(LzmaMtEnc_Block, &p, numBlocks, LzmaMt_GetNumThreads(numBlockThreads));
+
+  for (i = 0; i < LZMA_MT_THREADS_MAX; i++)
+    LzmaEncoderContext_Destroy(p.ctx[i]);
+  if (res != SZ_OK)
+  {
+    *destLen = 0;
+    return res;
+  }
+
+  /* join the slots and write the index */
+  outPos = 0;
+  for (i = 0; i < numBlocks; i++)
+  {
+    const Byte *block = dest + (size_t)i * p.slotSize;
+    size_t size = LZMA_MT_BLOCK_HEADER_SIZE + GetUi32(block + LZMA_PROPS_SIZE);
+    if (block != dest + outPos)
+      memmove(dest + outPos, block, size);
+    outPos += size;
+  }
+  for (i = 0, blockPos = 0; i < numBlocks; i++)
+  {
+    const Byte *block = dest + blockPos;
+    memcpy(dest + outPos, block + LZMA_PROPS_SIZE, LZMA_MT_INDEX_ITEM_SIZE);
+    outPos += LZMA_MT_INDEX_ITEM_SIZE;
+    blockPos += LZMA_MT_BLOCK_HEADER_SIZE + GetUi32(block + LZMA_PROPS_SIZE);
+  }
+  SetUi32(dest + outPos, (UInt32)p.srcLen);
+  SetUi32(dest + outPos + 4, (UInt32)((UInt64)p.srcLen >> 32));
+  SetUi32(dest + outPos + 8, numBlocks);
+  memcpy(dest + outPos + 12, kMtSignature, 4);
+  *destLen = outPos + LZMA_MT_FOOTER_SIZE;
+  return SZ_OK;
+}
+
+/* ---------- Decoder ---------- */
+
+typedef struct
+{
+  size_t inPos;
+  size_t outPos;
+  UInt32 packSize;
+  UInt32 unpackSize;
+} CLzmaMtBlock;
+
+typedef struct
+{
+  Byte *dest;
+  const Byte *src;
+  const CLzmaMtBlock *blocks;
+  LzmaDecoderContext ctx[LZMA_MT_THREADS_MAX];
+} CLzmaMtDec;
+
+/* each block is decoded directly to its offset in dest */
+
+static SRes LzmaMtDec_Block(void *pp, unsigned threadIndex, UInt32 blockIndex)
+{
+  CLzmaMtDec *p = (CLzmaMtDec *)pp;
+  const CLzmaMtBlock *block = &p->blocks[blockIndex];
+  const Byte *header = p->src + block->inPos;
+  size_t outSize = block->unpackSize;
+  SizeT inSize = block->packSize;
+  if (header[0] == LZMA_PROPS_STORED)
+  {
+    if (block->packSize != block->unpackSize)
+      return SZ_ERROR_DATA;
+    memcpy(p->dest + block->outPos, header + LZMA_MT_BLOCK_HEADER_SIZE, outSize);
+    return SZ_OK;
+  }
+  if (p->ctx[threadIndex] == 0)
+  {
+    p->ctx[threadIndex] = LzmaDecoderContext_Create();
+    if (p->ctx[threadIndex] == 0)
+      return SZ_ERROR_MEM;
+  }
+  RINOK(LzmaUncompressWithContext(p->ctx[threadIndex], p->dest + block->outPos, &outSize,
+      header + LZMA_MT_BLOCK_HEADER_SIZE, &inSize, header, LZMA_PROPS_SIZE));
+  return (outSize == block->unpackSize) ? SZ_OK : SZ_ERROR_DATA;
+}
+
+/* LzmaMt_ReadFooter checks the footer and the index position */
+
+static SRes LzmaMt_ReadFooter(const Byte *src, size_t srcLen, UInt64 *unpackSize, UInt32 *numBlocks)
+{
+  const Byte *footer;
+  if (srcLen < LZMA_MT_FOOTER_SIZE)
+    return SZ_ERROR_INPUT_EOF;
+  footer = src + srcLen - LZMA_MT_FOOTER_SIZE;
+  if (memcmp(footer + 12, kMtSignature, 4) != 0)
+    return SZ_ERROR_DATA;
+  *unpackSize = GetUi32(footer) | ((UInt64)GetUi32(footer + 4) << 32);
+  *numBlocks = GetUi32(footer + 8);
+  if ((UInt64)*numBlocks * (LZMA_MT_BLOCK_HEADER_SIZE + LZMA_MT_INDEX_ITEM_SIZE) > srcLen - LZMA_MT_FOOTER_SIZE)
+    return SZ_ERROR_DATA;
+  return SZ_OK;
+}
+
+int WINAPI LzmaUncompressMtGetSize(const unsigned char *src, size_t srcLen, UInt64 *unpackSize)
+{
+  UInt32 numBlocks;
+  return LzmaMt_ReadFooter(src, srcLen, unpackSize, &numBlocks);
+}
+
+int WINAPI LzmaUncompressMt(unsigned char *dest, size_t *destLen, const unsigned char *src, size_t srcLen,
+  int numBlockThreads)
+{
+  CLzmaMtDec p;
+  CLzmaMtBlock *blocks;
+  const Byte *index;
+  UInt64 unpackSize;
+  UInt32 numBlocks, i;
+  size_t inPos = 0, outPos = 0;
+  SRes res;
+
+  RINOK(LzmaMt_ReadFooter(src, srcLen, &unpackSize, &numBlocks));
+  if (unpackSize > *destLen)
+  {
+    *destLen = 0;
+    return SZ_ERROR_OUTPUT_EOF;
+  }
+  *destLen = 0;
+
+  /* the index must match the block headers and the total size */
+  index = src + srcLen - LZMA_MT_FOOTER_SIZE - (size_t)numBlocks * LZMA_MT_INDEX_ITEM_SIZE;
+  blocks = (CLzmaMtBlock *)MyAlloc((size_t)numBlocks * sizeof(CLzmaMtBlock) + 1);
+  if (blocks == 0)
+    return SZ_ERROR_MEM;
+  for (i = 0; i < numBlocks; i++)
+  {
+    CLzmaMtBlock *block = &blocks[i];
+    const Byte *item = index + (size_t)i * LZMA_MT_INDEX_ITEM_SIZE;
+    block->inPos = inPos;
+    block->outPos = outPos;
+    block->packSize = GetUi32(item);
+    block->unpackSize = GetUi32(item + 4);
+    if ((size_t)(index - src) - inPos < LZMA_MT_BLOCK_HEADER_SIZE
+        || block->packSize > (size_t)(index - src) - inPos - LZMA_MT_BLOCK_HEADER_SIZE
+        || block->unpackSize > unpackSize - outPos
+        || memcmp(src + inPos + LZMA_PROPS_SIZE, item, LZMA_MT_INDEX_ITEM_SIZE) != 0)
+    {
+      MyFree(blocks);
+      return SZ_ERROR_DATA;
+    }
+    inPos += LZMA_MT_BLOCK_HEADER_SIZE + block->packSize;
+    outPos += block->unpackSize;
+  }
+  if (src + inPos != index || outPos != unpackSize)
+  {
+    MyFree(blocks);
+    return SZ_ERROR_DATA;
+  }
+
+  p.dest = dest;
+  p.src = src;
+  p.blocks = blocks;
+  memset(p.ctx, 0, sizeof(p.ctx));
+
+  res = LzmaMt_Run(LzmaMtDec_Block, &p, numBlocks, LzmaMt_GetNumThreads(numBlockThreads));
+
+  for (i = 0; i < LZMA_MT_THREADS_MAX; i++)
+    LzmaDecoderContext_Destroy(p.ctx[i]);
+  MyFree(blocks);
+  if (res == SZ_OK)
+    *destLen = outPos;
+  return res;
+}
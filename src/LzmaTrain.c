@@ -0,0 +1,340 @@
+/* LzmaTrain.c -- Preset dictionary trainer
+2026-10-17 : Public domain */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "Alloc.h"
+#include "LzFind.h"
+#include "LzmaEnc.h"
+#include "LzmaLib.h"
+
+#define kTrainMinMatchLen 6
+#define kTrainMatchMaxLen 273
+#define kTrainCutValue 32
+#define kTrainSegmentSizeDefault 256
+#define kTrainSegmentSizeMin 16
+#define kTrainTotalSizeMax ((size_t)1 << 30)
+#define kTrainBigHashLimit ((UInt32)1 << 24)
+
+#define kTrainUsed ((UInt32)0xFFFFFFFF)
+
+#define kTrainProbInitValue (1 << 10)
+
+static void *SzAlloc(void *p, size_t size) { p = p; return MyAlloc(size); }
+static void SzFree(void *p, void *address) { p = p; MyFree(address); }
+static ISzAlloc g_Alloc = { SzAlloc, SzFree };
+static void *SzBigAlloc(void *p, size_t size) { p = p; return BigAlloc(size); }
+static void SzBigFree(void *p, void *address) { p = p; BigFree(address); }
+static ISzAlloc g_BigAlloc = { SzBigAlloc, SzBigFree };
+
+/*
+Train_Cover parses the samples greedily with the match finder (as the encoder
+does it) and counts, how many times each byte is copied by a match into a later
+sample. A match inherits the origin of its source bytes, so all copies of some
+string give their counts to its first occurrence: the popular strings get high
+counts at one place instead of small counts at each copy.
+Matches inside one sample are parsed, but not counted: they don't need a dictionary.
+*/
+
+static SRes Train_Cover(const Byte *data, UInt32 size, const size_t *sampleSizes, unsigned numSamples,
+    UInt32 *origin, UInt32 *cover)
+{
+  CMatchFinder mf;
+  IMatchFinder vt;
+  UInt32 matches[kTrainMatchMaxLen * 2 + 3];
+  UInt32 pos = 0, sampleStart = 0, sampleEnd = 0;
+  unsigned sampleIndex = 0;
+
+  MatchFinder_Construct(&mf);
+  mf.btMode = 0;
+  mf.numHashBytes = 4;
+  mf.cutValue = kTrainCutValue;
+  mf.bigHash = (size > kTrainBigHashLimit);
+  mf.directInput = 1;
+  mf.bufferBase = (Byte *)data;
+  mf.directInputRem = size;
+  if (!MatchFinder_Create(&mf, size < (1 << 12) ? (1 << 12) : size, 0, kTrainMatchMaxLen, 0, &g_BigAlloc))
+    return SZ_ERROR_MEM;
+  MatchFinder_CreateVTable(&mf, &vt);
+  vt.Init(&mf);
+
+  for (pos = 0; pos < size; pos++)
+  {
+    origin[pos] = pos;
+    cover[pos] = 0;
+  }
+
+  for (pos = 0; pos < size;)
+  {
+    UInt32 numPairs, len = 0, dist = 0;
+    /* size is the total size of numSamples samples, so the last sample ends at size */
+    while (pos >= sampleEnd && sampleIndex < numSamples)
+    {
+      sampleStart = sampleEnd;
+      sampleEnd += (UInt32)sampleSizes[sampleIndex++];
+    }
+    numPairs = vt.GetMatches(&mf, matches);
+    if (numPairs != 0)
+    {
+      len = matches[numPairs - 2];
+      dist = matches[numPairs - 1] + 1;
+    }
+    if (len > sampleEnd - pos)
+      len = sampleEnd - pos;
+    if (len < kTrainMinMatchLen)
+    {
+      pos++;
+      continue;
+    }
+    {
+      UInt32 src = pos - dist, i;
+      Bool credit = (src < sampleStart);
+      for (i = 0; i < len; i++)
+      {
+        UInt32 o = origin[src + i];
+        origin[pos + i] = o;
+        if (credit)
+          cover[o]++;
+      }
+    }
+    vt.Skip(&mf, len - 1);
+    pos += len;
+  }
+
+  MatchFinder_Free(&mf, &g_BigAlloc);
+  return SZ_OK;
+}
+
+typedef struct
+{
+  UInt32 pos;
+  UInt32 len;
+  UInt64 score;
+} CTrainSegment;
+
+static int Train_CompareScoreDesc(const void *a, const void *b)
+{
+  const CTrainSegment *s1 = (const CTrainSegment *)a;
+  const CTrainSegment *s2 = (const CTrainSegment *)b;
+  if (s1->score != s2->score)
+    return (s1->score > s2->score) ? -1 : 1;
+  return (s1->pos < s2->pos) ? -1 : (s1->pos > s2->pos);
+}
+
+static int Train_CompareScoreAsc(const void *a, const void *b)
+{
+  return Train_CompareScoreDesc(b, a);
+}
+
+static void Train_AddSegment(CTrainSegment *segments, UInt32 *numSegments, const UInt32 *cover,
+    UInt32 pos, UInt32 len)
+{
+  CTrainSegment *s = &segments[*numSegments];
+  UInt32 i;
+  s->pos = pos;
+  s->len = len;
+  s->score = 0;
+  for (i = 0; i < len; i++)
+    s->score += cover[pos + i];
+  if (s->score != 0)
+    (*numSegments)++;
+}
+
+int WINAPI LzmaTrainDict(unsigned char *dict, size_t *dictLen,
+  const unsigned char *samples, const size_t *sampleSizes, unsigned numSamples,
+  unsigned segmentSize)
+{
+  size_t capacity = *dictLen, total = 0, outPos = 0;
+  UInt32 *origin, *cover;
+  CTrainSegment *segments;
+  UInt32 numSegments = 0, numChosen = 0, maxSegments = 0, step, i;
+  UInt32 sampleStart;
+  SRes res;
+
+  *dictLen = 0;
+  if (segmentSize == 0)
+    segmentSize = kTrainSegmentSizeDefault;
+  if (segmentSize < kTrainSegmentSizeMin)
+    return SZ_ERROR_PARAM;
+  for (i = 0; i < numSamples; i++)
+  {
+    if (sampleSizes[i] > kTrainTotalSizeMax - total)
+      return SZ_ERROR_PARAM;
+    total += sampleSizes[i];
+    /* windows of (segmentSize) with step (segmentSize / 4) and one more window at the end */
+    maxSegments += (UInt32)(sampleSizes[i] / (segmentSize / 4)) + 2;
+  }
+  if (total == 0 || capacity == 0)
+    return SZ_OK;
+
+  origin = (UInt32 *)MyAlloc(total * sizeof(UInt32));
+  cover = (UInt32 *)MyAlloc(total * sizeof(UInt32));
+  segments = (CTrainSegment *)MyAlloc(maxSegments * sizeof(CTrainSegment));
+  if (origin == 0 || cover == 0 || segments == 0)
+  {
+    MyFree(origin);
+    MyFree(cover);
+    MyFree(segments);
+    return SZ_ERROR_MEM;
+  }
+
+  res = Train_Cover(samples, (UInt32)total, sampleSizes, numSamples, origin, cover);
+
+  if (res == SZ_OK)
+  {
+    /* the candidates: overlapping windows inside each sample, small samples as a whole */
+    step = segmentSize / 4;
+    for (i = 0, sampleStart = 0; i < numSamples; sampleStart += (UInt32)sampleSizes[i++])
+    {
+      UInt32 size = (UInt32)sampleSizes[i], pos;
+      if (size <= segmentSize)
+      {
+        if (size != 0)
+          Train_AddSegment(segments, &numSegments, cover, sampleStart, size);
+        continue;
+      }
+      for (pos = 0; pos + segmentSize <= size; pos += step)
+        Train_AddSegment(segments, &numSegments, cover, sampleStart + pos, segmentSize);
+      if (pos - step + segmentSize != size)
+        Train_AddSegment(segments, &numSegments, cover, sampleStart + size - segmentSize, segmentSize);
+    }
+    qsort(segments, numSegments, sizeof(CTrainSegment), Train_CompareScoreDesc);
+
+    /* greedy choice of the best windows that don't overlap.
+       origin[] is not needed anymore, it marks the chosen bytes.
+       The windows of one sample have the same size, so it's enough to check the ends. */
+    for (i = 0; i < numSegments && capacity - outPos >= kTrainSegmentSizeMin; i++)
+    {
+      CTrainSegment s = segments[i];
+      UInt32 k;
+      if (s.len > capacity - outPos
+          || origin[s.pos] == kTrainUsed || origin[s.pos + s.len - 1] == kTrainUsed)
+        continue;
+      for (k = 0; k < s.len; k++)
+        origin[s.pos + k] = kTrainUsed;
+      segments[numChosen++] = s;
+      outPos += s.len;
+    }
+
+    /* the best segments are written at the end of dictionary: they get the shortest
+       distances, and they are kept, if the dictionary is larger than dictSize */
+    qsort(segments, numChosen, sizeof(CTrainSegment), Train_CompareScoreAsc);
+    for (i = 0, outPos = 0; i < numChosen; i++)
+    {
+      memcpy(dict + outPos, samples + segments[i].pos, segments[i].len);
+      outPos += segments[i].len;
+    }
+    *dictLen = outPos;
+  }
+
+  MyFree(origin);
+  MyFree(cover);
+  MyFree(segments);
+  return res;
+}
+
+/*
+LzmaTrainModel encodes the samples one by one, each sample starts with the
+probabilities left by the previous one (as with LzmaCompressWithModel), and
+the model is the average of the probabilities at the end of the samples.
+So it's the state that the encoder has after the typical message, and the
+long series of similar samples don't push it to the extreme values.
+*/
+
+int WINAPI LzmaTrainModel(unsigned char *model, size_t *modelSize, unsigned modelId,
+  const unsigned char *samples, const size_t *sampleSizes, unsigned numSamples,
+  int level, int lc, int lp, int pb)
+{
+  CLzmaEncProps props;
+  CLzmaEncHandle enc;
+  UInt16 *probs;
+  UInt64 *sums;
+  Byte *dest;
+  size_t maxSize = 0, destSize, size, pos;
+  UInt32 numProbs, numEncoded = 0, i;
+  SRes res = SZ_OK;
+
+  if (lc < 0) lc = 3;
+  if (lp < 0) lp = 0;
+  if (pb < 0) pb = 2;
+  size = LzmaModelSize(lc, lp);
+  if (size == 0)
+    return SZ_ERROR_PARAM;
+  if (*modelSize < size)
+    return SZ_ERROR_OUTPUT_EOF;
+  *modelSize = 0;
+  numProbs = LZMA_MODEL_NUM_PROBS(lc, lp);
+
+  for (i = 0; i < numSamples; i++)
+    if (maxSize < sampleSizes[i])
+      maxSize = sampleSizes[i];
+  destSize = LzmaCompressBound(maxSize);
+  if (destSize == 0)
+    return SZ_ERROR_PARAM;
+
+  LzmaEncProps_Init(&props);
+  props.level = level;
+  props.lc = lc;
+  props.lp = lp;
+  props.pb = pb;
+  props.numThreads = 1;
+  props.reduceSize = maxSize;
+
+  enc = LzmaEnc_Create(&g_Alloc);
+  probs = (UInt16 *)MyAlloc(numProbs * sizeof(UInt16));
+  sums = (UInt64 *)MyAlloc(numProbs * sizeof(UInt64));
+  dest = (Byte *)MyAlloc(destSize);
+  if (enc == 0 || probs == 0 || sums == 0 || dest == 0)
+    res = SZ_ERROR_MEM;
+  if (res == SZ_OK)
+    res = LzmaEnc_SetProps(enc, &props);
+
+  if (res == SZ_OK)
+  {
+    for (i = 0; i < numProbs; i++)
+    {
+      probs[i] = kTrainProbInitValue;
+      sums[i] = 0;
+    }
+    LzmaEnc_SetModel(enc, probs);
+    for (i = 0, pos = 0; i < numSamples && res == SZ_OK; pos += sampleSizes[i++])
+    {
+      SizeT destLen = destSize;
+      UInt32 k;
+      if (sampleSizes[i] == 0)
+        continue;
+      res = LzmaEnc_MemEncode(enc, dest, &destLen, samples + pos, sampleSizes[i], 0, NULL, &g_Alloc, &g_BigAlloc);
+      LzmaEnc_SaveModel(enc, probs);
+      for (k = 0; k < numProbs; k++)
+        sums[k] += probs[k];
+      numEncoded++;
+    }
+  }
+
+  if (res == SZ_OK)
+  {
+    Byte *p = model;
+    p[0] = 'L'; p[1] = 'Z'; p[2] = 'M'; p[3] = 'P';
+    for (i = 0; i < 4; i++)
+      p[4 + i] = (Byte)(modelId >> (8 * i));
+    p[8] = (Byte)((pb * 5 + lp) * 9 + lc);
+    p += LZMA_MODEL_HEADER_SIZE;
+    for (i = 0; i < numProbs; i++, p += 2)
+    {
+      UInt32 v = kTrainProbInitValue;
+      if (numEncoded != 0)
+        v = (UInt32)((sums[i] + numEncoded / 2) / numEncoded);
+      p[0] = (Byte)v;
+      p[1] = (Byte)(v >> 8);
+    }
+    *modelSize = size;
+  }
+
+  if (enc != 0)
+    LzmaEnc_Destroy(enc, &g_Alloc, &g_BigAlloc);
+  MyFree(probs);
+  MyFree(sums);
+  MyFree(dest);
+  return res;
+}
@@ -0,0 +1,722 @@
+//
+//  LZMA compression benchmark
+//
+//  Runs LzmaCompressEx/LzmaUncompressEx ("lib") and LzmaEnc_*/LzmaDec_* ("enc")
+//  over a deterministic built-in corpus and prints the results as JSON.
+//  peak_alloc is the peak of the memory allocated by the library in one case;
+//  process_max_rss_kb is the peak of the whole process up to that case.
+//
+//  Build (Linux, from the repository root):
+//      gcc -O2 -c -Iinclude -Iinclude/LzmaLib src/*.c
+//      g++ -O2 -Iinclude -Iinclude/LzmaLib -Isrc tools/LzmaBench.cpp *.o -lpthread -o LzmaBench
+//
+//  Usage:
+//      LzmaBench [--corpus text,logs,json,binary,random,zeros] [--sizes 64K,1M]
+//                [--levels 0-9] [--dicts 0,1M,16M] [--threads 1,2] [--api lib,enc]
+//                [--min-time 0.1] [--min-iter 3] [--max-iter 50] [--out file.json]
+//      LzmaBench --files 5G [--levels 1] [--dicts 0] [--threads 1,2] [--out file.json]
+//
+//  dict 0 means the default dictionary size of the level.
+//  Every result is checked by decompression; a mismatch makes exit code 1.
+//  --files runs LzmaCompressFile instead of the corpus: the source is a sparse file
+//  in $TMPDIR (or /tmp) with random blocks every 1 GB, and the packed file is decoded
+//  as a stream and compared with it. Sizes over 4 GB check the 32-bit positions
+//  of the match finder.
+//
+
+#define _FILE_OFFSET_BITS 64
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <LzmaLib/LzmaLib.h>
+#include "LzmaDec.h"
+#include "LzmaEnc.h"
+
+namespace {
+
+typedef std::vector<unsigned char> Buffer;
+
+// ---------------------------------------------------------------------------
+// Corpus
+
+class Random
+{
+public:
+    explicit Random(unsigned long long seed) : state(seed * 2685821657736338717ULL + 1) {}
+
+    unsigned long long next()
+    {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return state * 2685821657736338717ULL;
+    }
+
+    unsigned below(unsigned n) { return (unsigned)(next() >> 33) % n; }
+
+    // Small values are much more likely, like word frequencies in a text.
+    unsigned skewed(unsigned n) { return below(below(n) + 1); }
+
+private:
+    unsigned long long state;
+};
+
+const char *const kWords[] = {
+    "the", "of", "and", "to", "in", "a", "is", "that", "for", "it", "as", "was", "with",
+    "be", "by", "on", "not", "he", "this", "are", "or", "his", "from", "at", "which",
+    "but", "have", "an", "had", "they", "you", "were", "their", "one", "all", "we",
+    "can", "her", "has", "there", "been", "if", "more", "when", "will", "would", "who",
+    "so", "no", "compression", "dictionary", "window", "stream", "buffer", "encoder",
+    "decoder", "probability", "literal", "match", "distance", "length", "thread",
+    "block", "header", "archive", "memory", "performance", "latency", "throughput"
+};
+const unsigned kNumWords = sizeof(kWords) / sizeof(kWords[0]);
+
+// The state of one corpus. makeCorpus creates it, so a corpus of the given size
+// doesn't depend on the other sizes and on the order of the runs.
+struct Generator
+{
+    Random rnd;
+    unsigned long long ms;
+    unsigned id;
+
+    explicit Generator(unsigned long long seed) : rnd(seed), ms(0), id(0) {}
+};
+
+void appendf(std::string &s, const char *format, ...)
+{
+    char line[512];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    if (len > 0)
+        s.append(line, std::min((size_t)len, sizeof(line) - 1));
+}
+
+void genText(std::string &s, Generator &g)
+{
+    Random &rnd = g.rnd;
+    unsigned n = 5 + rnd.below(15);
+    for (unsigned i = 0; i < n; i++)
+    {
+        const char *w = kWords[rnd.skewed(kNumWords)];
+        if (i == 0)
+        {
+            s += (char)(w[0] - 'a' + 'A');
+            s += w + 1;
+        }
+        else
+        {
+            s += ' ';
+            s += w;
+        }
+    }
+    s += rnd.below(8) == 0 ? ".\n" : ". ";
+}
+
+void genLogs(std::string &s, Generator &g)
+{
+    static const char *const kLevels[] = { "INFO", "INFO", "INFO", "DEBUG", "WARN", "ERROR" };
+    Random &rnd = g.rnd;
+    unsigned long long ms = (g.ms += rnd.below(50));
+    appendf(s, "2014-09-17 %02u:%02u:%02u.%03u %-5s [worker-%u] %s /api/v1/%s/%u status=%u latency_ms=%u\n",
+        (unsigned)(ms / 3600000 % 24), (unsigned)(ms / 60000 % 60), (unsigned)(ms / 1000 % 60), (unsigned)(ms % 1000),
+        kLevels[rnd.below(6)], rnd.below(8), rnd.below(4) ? "GET" : "POST",
+        kWords[rnd.skewed(kNumWords)], rnd.below(100000), rnd.below(10) ? 200 : 404, rnd.skewed(500));
+}
+
+void genJson(std::string &s, Generator &g)
+{
+    Random &rnd = g.rnd;
+    appendf(s, "{\"id\":%u,\"name\":\"%s %s\",\"score\":%u.%02u,\"active\":%s,\"tags\":[\"%s\",\"%s\"]},\n",
+        ++g.id, kWords[rnd.skewed(kNumWords)], kWords[rnd.skewed(kNumWords)],
+        rnd.below(100), rnd.below(100), rnd.below(2) ? "true" : "false",
+        kWords[rnd.skewed(kNumWords)], kWords[rnd.skewed(kNumWords)]);
+}
+
+// Looks like x86 code: frequent opcodes, small immediates and call/jmp offsets.
+void genBinary(std::string &s, Generator &g)
+{
+    Random &rnd = g.rnd;
+    static const unsigned char kOps[] = { 0x8B, 0x89, 0x48, 0x83, 0xFF, 0x74, 0x75, 0x0F, 0x85, 0xC3, 0x55, 0x5D };
+    unsigned n = 1 + rnd.below(16);
+    for (unsigned i = 0; i < n; i++)
+    {
+        s += (char)kOps[rnd.skewed(sizeof(kOps))];
+        s += (char)(0xC0 + rnd.below(16));
+    }
+    unsigned op = rnd.below(4);
+    if (op == 0)
+    {
+        unsigned offset = (unsigned)s.size() + rnd.skewed(4096) * 4;
+        s += (char)0xE8;
+        for (int k = 0; k < 4; k++)
+            s += (char)(offset >> (8 * k));
+    }
+    else if (op == 1)
+        s.append(4 + rnd.below(12), '\0');
+}
+
+void genRandom(std::string &s, Generator &g)
+{
+    Random &rnd = g.rnd;
+    unsigned long long v = rnd.next();
+    s.append((const char *)&v, sizeof(v));
+}
+
+void genZeros(std::string &s, Generator &)
+{
+    s.append(4096, '\0');
+}
+
+struct CorpusKind
+{
+    const char *name;
+    void (*generate)(std::string &s, Generator &g);
+};
+
+const CorpusKind kCorpus[] = {
+    { "text", genText },
+    { "logs", genLogs },
+    { "json", genJson },
+    { "binary", genBinary },
+    { "random", genRandom },
+    { "zeros", genZeros }
+};
+const unsigned kNumCorpus = sizeof(kCorpus) / sizeof(kCorpus[0]);
+
+Buffer makeCorpus(const CorpusKind &kind, size_t size)
+{
+    Generator g(size + 1);
+    std::string s;
+    s.reserve(size + 4096);
+    while (s.size() < size)
+        kind.generate(s, g);
+    return Buffer(s.begin(), s.begin() + size);
+}
+
+// ---------------------------------------------------------------------------
+// Measuring
+
+double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// The high-water mark of the whole process, not of one case.
+long maxRssKb()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+// ISzAlloc that counts the peak of allocated bytes.
+struct TrackingAlloc
+{
+    ISzAlloc funcTable;
+    size_t current;
+    size_t peak;
+
+    TrackingAlloc() : current(0), peak(0)
+    {
+        funcTable.Alloc = alloc;
+        funcTable.Free = free;
+    }
+
+    static void *alloc(void *p, size_t size)
+    {
+        TrackingAlloc *self = (TrackingAlloc *)p;
+        size_t *block = (size_t *)malloc(size + sizeof(size_t) * 2);
+        if (!block)
+            return 0;
+        block[0] = size;
+        self->current += size;
+        self->peak = std::max(self->peak, self->current);
+        return block + 2;
+    }
+
+    static void free(void *p, void *address)
+    {
+        if (address)
+        {
+            size_t *block = (size_t *)address - 2;
+            ((TrackingAlloc *)p)->current -= block[0];
+            ::free(block);
+        }
+    }
+};
+
+struct Params
+{
+    int level;
+    unsigned dictSize;
+    int numThreads;
+    bool encApi;
+};
+
+struct Packed
+{
+    Buffer data;
+    unsigned char props[LZMA_PROPS_SIZE];
+};
+
+bool compress(const Params &params, const Buffer &src, Packed &packed, TrackingAlloc &alloc)
+{
+    packed.data.resize(LzmaCompressBound(src.size()));
+    size_t destLen = packed.data.size();
+    size_t propsSize = LZMA_PROPS_SIZE;
+    if (!params.encApi)
+    {
+        int res = LzmaCompressEx(&packed.data[0], &destLen, src.empty() ? 0 : &src[0], src.size(),
+            packed.props, &propsSize, params.level, params.dictSize, -1, -1, -1, -1, params.numThreads,
+            &alloc.funcTable, &alloc.funcTable);
+        packed.data.resize(destLen);
+        return res == SZ_OK;
+    }
+
+    CLzmaEncProps props;
+    LzmaEncProps_Init(&props);
+    props.level = params.level;
+    props.dictSize = params.dictSize;
+    props.numThreads = params.numThreads;
+    props.reduceSize = src.size();
+    CLzmaEncHandle enc = LzmaEnc_Create(&alloc.funcTable);
+    if (!enc)
+        return false;
+    SizeT outPropsSize = LZMA_PROPS_SIZE;
+    SizeT outLen = destLen;
+    SRes res = LzmaEnc_SetProps(enc, &props);
+    if (res == SZ_OK)
+        res = LzmaEnc_WriteProperties(enc, packed.props, &outPropsSize);
+    if (res == SZ_OK)
+        res = LzmaEnc_MemEncode(enc, &packed.data[0], &outLen, src.empty() ? 0 : &src[0], src.size(),
+            0, NULL, &alloc.funcTable, &alloc.funcTable);
+    LzmaEnc_Destroy(enc, &alloc.funcTable, &alloc.funcTable);
+    packed.data.resize(outLen);
+    return res == SZ_OK;
+}
+
+bool decompress(const Params &params, const Packed &packed, Buffer &dest, TrackingAlloc &alloc)
+{
+    size_t destLen = dest.size();
+    SizeT srcLen = packed.data.size();
+    if (!params.encApi)
+        return LzmaUncompressEx(dest.empty() ? 0 : &dest[0], &destLen, &packed.data[0], &srcLen,
+            packed.props, LZMA_PROPS_SIZE, &alloc.funcTable) == SZ_OK && destLen == dest.size();
+
+    CLzmaDec dec;
+    LzmaDec_Construct(&dec);
+    if (LzmaDec_Allocate(&dec, packed.props, LZMA_PROPS_SIZE, &alloc.funcTable) != SZ_OK)
+        return false;
+    LzmaDec_Init(&dec);
+    SizeT outLen = destLen;
+    ELzmaStatus status;
+    SRes res = LzmaDec_DecodeToBuf(&dec, dest.empty() ? 0 : &dest[0], &outLen, &packed.data[0], &srcLen,
+        LZMA_FINISH_END, &status);
+    LzmaDec_Free(&dec, &alloc.funcTable);
+    return res == SZ_OK && outLen == destLen;
+}
+
+struct Timing
+{
+    double total;
+    std::vector<double> samples;
+
+    Timing() : total(0) {}
+
+    void add(double t)
+    {
+        total += t;
+        samples.push_back(t);
+    }
+
+    double percentile(double p)
+    {
+        std::sort(samples.begin(), samples.end());
+        size_t rank = (size_t)(p * samples.size() + 0.999999);
+        return samples[rank == 0 ? 0 : rank - 1];
+    }
+};
+
+struct Options
+{
+    std::vector<unsigned> corpus;
+    std::vector<size_t> sizes;
+    std::vector<size_t> files;
+    std::vector<int> levels;
+    std::vector<unsigned> dicts;
+    std::vector<int> threads;
+    std::vector<bool> apis;
+    double minTime;
+    unsigned minIter;
+    unsigned maxIter;
+    const char *out;
+
+    Options() : minTime(0.1), minIter(3), maxIter(50), out(0) {}
+};
+
+void printTiming(FILE *f, const char *name, Timing &t, size_t size)
+{
+    fprintf(f, "\"%s\":{\"mb_s\":%.3f,\"p50_ms\":%.4f,\"p99_ms\":%.4f}", name,
+        t.total > 0 ? size * (double)t.samples.size() / t.total / 1e6 : 0.0,
+        t.percentile(0.5) * 1e3, t.percentile(0.99) * 1e3);
+}
+
+bool runCase(FILE *f, bool &first, const Options &opt, const char *corpusName, const Buffer &src, const Params &params)
+{
+    Timing enc, dec;
+    TrackingAlloc encAlloc, decAlloc;
+    Packed packed;
+    Buffer dest(src.size());
+    bool ok = true;
+    double start = now();
+    for (unsigned i = 0; i < opt.maxIter && ok; i++)
+    {
+        if (i >= opt.minIter && now() - start >= opt.minTime)
+            break;
+        double t = now();
+        ok = compress(params, src, packed, encAlloc);
+        enc.add(now() - t);
+    }
+    start = now();
+    for (unsigned i = 0; i < opt.maxIter && ok; i++)
+    {
+        if (i >= opt.minIter && now() - start >= opt.minTime)
+            break;
+        double t = now();
+        ok = decompress(params, packed, dest, decAlloc);
+        dec.add(now() - t);
+    }
+    ok = ok && dest == src;
+
+    fprintf(f, "%s\n  {\"corpus\":\"%s\",\"size\":%lu,\"api\":\"%s\",\"level\":%d,\"dict\":%u,\"threads\":%d,",
+        first ? "" : ",", corpusName, (unsigned long)src.size(), params.encApi ? "enc" : "lib",
+        params.level, params.dictSize, params.numThreads);
+    first = false;
+    if (!ok)
+    {
+        fprintf(f, "\"ok\":false}");
+        return false;
+    }
+    fprintf(f, "\"ok\":true,\"packed\":%lu,\"ratio\":%.4f,\"iterations\":[%lu,%lu],",
+        (unsigned long)packed.data.size(), packed.data.empty() ? 0.0 : (double)src.size() / packed.data.size(),
+        (unsigned long)enc.samples.size(), (unsigned long)dec.samples.size());
+    printTiming(f, "compress", enc, src.size());
+    fputc(',', f);
+    printTiming(f, "decompress", dec, src.size());
+    fprintf(f, ",\"peak_alloc\":{\"compress\":%lu,\"decompress\":%lu}",
+        (unsigned long)encAlloc.peak, (unsigned long)decAlloc.peak);
+    fprintf(f, ",\"process_max_rss_kb\":%ld}", maxRssKb());
+    fflush(f);
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Files
+
+const size_t kFileBlockStep = (size_t)1 << 30;
+const size_t kFileBlockSize = 4096;
+
+bool makeSparseFile(const char *path, size_t size)
+{
+    FILE *f = fopen(path, "wb");
+    if (!f)
+        return false;
+    Random rnd(size + 1);
+    unsigned char block[kFileBlockSize];
+    bool ok = true;
+    for (size_t pos = 0; pos < size && ok; pos += kFileBlockStep)
+    {
+        size_t blockSize = std::min(kFileBlockSize, size - pos);
+        for (size_t i = 0; i < blockSize; i++)
+            block[i] = (unsigned char)rnd.next();
+        ok = fseeko(f, (off_t)pos, SEEK_SET) == 0 && fwrite(block, 1, blockSize, f) == blockSize;
+    }
+    ok = ok && ftruncate(fileno(f), (off_t)size) == 0;
+    return fclose(f) == 0 && ok;
+}
+
+// Decodes the .lzma file by 1 MB and compares it with the source.
+bool checkPackedFile(const char *srcPath, const char *packedPath, size_t size, size_t &packedSize)
+{
+    FILE *in = fopen(packedPath, "rb");
+    FILE *orig = fopen(srcPath, "rb");
+    unsigned char header[LZMA_PROPS_SIZE + 8];
+    bool ok = in && orig && fread(header, 1, sizeof(header), in) == sizeof(header);
+    unsigned long long headerSize = 0;
+    for (int i = 0; i < 8 && ok; i++)
+        headerSize |= (unsigned long long)header[LZMA_PROPS_SIZE + i] << (8 * i);
+    ok = ok && headerSize == size;
+
+    TrackingAlloc alloc;
+    CLzmaDec dec;
+    LzmaDec_Construct(&dec);
+    ok = ok && LzmaDec_Allocate(&dec, header, LZMA_PROPS_SIZE, &alloc.funcTable) == SZ_OK;
+    if (ok)
+    {
+        Buffer inBuf(1 << 16), outBuf(1 << 20), origBuf(1 << 20);
+        size_t inPos = 0, inSize = 0, total = 0;
+        LzmaDec_Init(&dec);
+        while (ok && total != size)
+        {
+            if (inPos == inSize)
+            {
+                inSize = fread(&inBuf[0], 1, inBuf.size(), in);
+                inPos = 0;
+            }
+            SizeT inProcessed = inSize - inPos;
+            SizeT outProcessed = std::min(outBuf.size(), size - total);
+            ELzmaStatus status;
+            ok = LzmaDec_DecodeToBuf(&dec, &outBuf[0], &outProcessed, &inBuf[inPos], &inProcessed,
+                LZMA_FINISH_ANY, &status) == SZ_OK && (inProcessed != 0 || outProcessed != 0);
+            inPos += inProcessed;
+            ok = ok && fread(&origBuf[0], 1, outProcessed, orig) == outProcessed
+                && memcmp(&outBuf[0], &origBuf[0], outProcessed) == 0;
+            total += outProcessed;
+        }
+        LzmaDec_Free(&dec, &alloc.funcTable);
+    }
+    if (in)
+    {
+        fseeko(in, 0, SEEK_END);
+        packedSize = (size_t)ftello(in);
+        fclose(in);
+    }
+    if (orig)
+        fclose(orig);
+    return ok;
+}
+
+bool runFileCase(FILE *f, bool &first, const std::string &srcPath, size_t size, const Params &params)
+{
+    std::string packedPath = srcPath + ".lzma";
+    double t = now();
+    int res = LzmaCompressFile(srcPath.c_str(), packedPath.c_str(), params.level, params.dictSize,
+        -1, -1, -1, -1, params.numThreads);
+    t = now() - t;
+    size_t packedSize = 0;
+    bool ok = res == SZ_OK && checkPackedFile(srcPath.c_str(), packedPath.c_str(), size, packedSize);
+    remove(packedPath.c_str());
+
+    fprintf(f, "%s\n  {\"corpus\":\"sparse\",\"size\":%llu,\"api\":\"file\",\"level\":%d,\"dict\":%u,\"threads\":%d,",
+        first ? "" : ",", (unsigned long long)size, params.level, params.dictSize, params.numThreads);
+    first = false;
+    if (!ok)
+    {
+        fprintf(f, "\"ok\":false,\"res\":%d}", res);
+        return false;
+    }
+    fprintf(f, "\"ok\":true,\"packed\":%llu,\"compress\":{\"mb_s\":%.3f}}",
+        (unsigned long long)packedSize, t > 0 ? size / t / 1e6 : 0.0);
+    fflush(f);
+    return true;
+}
+
+bool runFiles(FILE *f, bool &first, const Options &opt)
+{
+    const char *dir = getenv("TMPDIR");
+    std::string srcPath = std::string(dir && *dir ? dir : "/tmp") + "/LzmaBench.file";
+    bool ok = true;
+    for (size_t s = 0; s < opt.files.size(); s++)
+    {
+        if (!makeSparseFile(srcPath.c_str(), opt.files[s]))
+        {
+            perror(srcPath.c_str());
+            remove(srcPath.c_str());
+            return false;
+        }
+        for (size_t l = 0; l < opt.levels.size(); l++)
+            for (size_t d = 0; d < opt.dicts.size(); d++)
+                for (size_t t = 0; t < opt.threads.size(); t++)
+                {
+                    Params params;
+                    params.level = opt.levels[l];
+                    params.dictSize = opt.dicts[d];
+                    params.numThreads = opt.threads[t];
+                    params.encApi = false;
+                    if (!runFileCase(f, first, srcPath, opt.files[s], params))
+                        ok = false;
+                }
+        remove(srcPath.c_str());
+    }
+    return ok;
+}
+
+// ---------------------------------------------------------------------------
+// Command line
+
+size_t parseSize(const std::string &s)
+{
+    char *end;
+    size_t v = (size_t)strtoul(s.c_str(), &end, 10);
+    if (*end == 'K' || *end == 'k')
+        v <<= 10;
+    else if (*end == 'M' || *end == 'm')
+        v <<= 20;
+    else if (*end == 'G' || *end == 'g')
+        v <<= 30;
+    return v;
+}
+
+std::vector<std::string> split(const char *s)
+{
+    std::vector<std::string> items;
+    std::string item;
+    for (; ; s++)
+    {
+        if (*s == ',' || *s == 0)
+        {
+            if (!item.empty())
+                items.push_back(item);
+            item.clear();
+            if (*s == 0)
+                break;
+        }
+        else
+            item += *s;
+    }
+    return items;
+}
+
+// "0-9" or "1,5,9"
+std::vector<int> parseInts(const char *s)
+{
+    std::vector<int> values;
+    std::vector<std::string> items = split(s);
+    for (size_t i = 0; i < items.size(); i++)
+    {
+        int from = atoi(items[i].c_str()), to = from;
+        size_t dash = items[i].find('-', 1);
+        if (dash != std::string::npos)
+            to = atoi(items[i].c_str() + dash + 1);
+        for (int v = from; v <= to; v++)
+            values.push_back(v);
+    }
+    return values;
+}
+
+bool parseOptions(int argc, char **argv, Options &opt)
+{
+    const char *corpus = "text,logs,json,binary,random,zeros";
+    const char *sizes = "64K,1M";
+    const char *levels = "0-9";
+    const char *dicts = "0";
+    const char *threads = "1,2";
+    const char *apis = "lib,enc";
+    const char *files = "";
+    for (int i = 1; i < argc; i++)
+    {
+        std::string name = argv[i];
+        if (i + 1 >= argc)
+            return false;
+        const char *value = argv[++i];
+        if (name == "--corpus") corpus = value;
+        else if (name == "--sizes") sizes = value;
+        else if (name == "--files") files = value;
+        else if (name == "--levels") levels = value;
+        else if (name == "--dicts") dicts = value;
+        else if (name == "--threads") threads = value;
+        else if (name == "--api") apis = value;
+        else if (name == "--min-time") opt.minTime = atof(value);
+        else if (name == "--min-iter") opt.minIter = (unsigned)atoi(value);
+        else if (name == "--max-iter") opt.maxIter = (unsigned)atoi(value);
+        else if (name == "--out") opt.out = value;
+        else
+            return false;
+    }
+
+    std::vector<std::string> items = split(corpus);
+    for (size_t i = 0; i < items.size(); i++)
+    {
+        unsigned k = 0;
+        while (k < kNumCorpus && items[i] != kCorpus[k].name)
+            k++;
+        if (k == kNumCorpus)
+            return false;
+        opt.corpus.push_back(k);
+    }
+    items = split(sizes);
+    for (size_t i = 0; i < items.size(); i++)
+        opt.sizes.push_back(parseSize(items[i]));
+    items = split(files);
+    for (size_t i = 0; i < items.size(); i++)
+        opt.files.push_back(parseSize(items[i]));
+    items = split(dicts);
+    for (size_t i = 0; i < items.size(); i++)
+        opt.dicts.push_back((unsigned)parseSize(items[i]));
+    items = split(apis);
+    for (size_t i = 0; i < items.size(); i++)
+    {
+        if (items[i] != "lib" && items[i] != "enc")
+            return false;
+        opt.apis.push_back(items[i] == "enc");
+    }
+    opt.levels = parseInts(levels);
+    opt.threads = parseInts(threads);
+    return opt.maxIter != 0 && !opt.corpus.empty() && !opt.sizes.empty() && !opt.levels.empty()
+        && !opt.dicts.empty() && !opt.threads.empty() && !opt.apis.empty();
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    Options opt;
+    if (!parseOptions(argc, argv, opt))
+    {
+        fprintf(stderr, "Usage: %s [--corpus text,logs,json,binary,random,zeros] [--sizes 64K,1M]\n"
+                        "       [--levels 0-9] [--dicts 0,1M,16M] [--threads 1,2] [--api lib,enc]\n"
+                        "       [--min-time 0.1] [--min-iter 3] [--max-iter 50] [--out file.json]\n"
+                        "       %s --files 5G [--levels 1] [--dicts 0] [--threads 1,2] [--out file.json]\n",
+            argv[0], argv[0]);
+        return 2;
+    }
+    FILE *f = opt.out ? fopen(opt.out, "w") : stdout;
+    if (!f)
+    {
+        perror(opt.out);
+        return 2;
+    }
+
+    bool ok = true, first = true;
+    fprintf(f, "{\"benchmark\":\"LzmaBench\",\"results\":[");
+    if (!opt.files.empty())
+        ok = runFiles(f, first, opt);
+    for (size_t c = 0; c < opt.corpus.size() && opt.files.empty(); c++)
+        for (size_t s = 0; s < opt.sizes.size(); s++)
+        {
+            const CorpusKind &kind = kCorpus[opt.corpus[c]];
+            Buffer src = makeCorpus(kind, opt.sizes[s]);
+            for (size_t a = 0; a < opt.apis.size(); a++)
+                for (size_t l = 0; l < opt.levels.size(); l++)
+                    for (size_t d = 0; d < opt.dicts.size(); d++)
+                        for (size_t t = 0; t < opt.threads.size(); t++)
+                        {
+                            Params params;
+                            params.level = opt.levels[l];
+                            params.dictSize = opt.dicts[d];
+                            params.numThreads = opt.threads[t];
+                            params.encApi = opt.apis[a];
+                            if (!runCase(f, first, opt, kind.name, src, params))
+                                ok = false;
+                        }
+        }
+    fprintf(f, "\n]}\n");
+    if (f != stdout)
+        fclose(f);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,309 @@
+//
+//  Preset dictionary trainer
+//
+//  Builds a dictionary for LzmaCompressWithDict/LzmaUncompressWithDict from
+//  sample files with LzmaTrainDict and writes it as raw bytes: load the file
+//  and pass its contents as (dict, dictLen) to both functions.
+//  With -m it also builds the probability model (LzmaTrainModel) for
+//  LzmaCompressWithModel/LzmaUncompressWithModel.
+//
+//  Build (Linux, from the repository root):
+//      gcc -O2 -c -Iinclude -Iinclude/LzmaLib src/*.c
+//      g++ -O2 -Iinclude -Iinclude/LzmaLib tools/LzmaTrain.cpp *.o -lpthread -o LzmaTrain
+//
+//  Usage:
+//      LzmaTrain [-o dict.bin] [-m model.bin] [--model-id 1] [--max-size 64K]
+//                [--segment 256] [--lines] [--level 5] [--test] files...
+//
+//  Every file is one sample; with --lines every line of the files is a sample.
+//  --test holds out every 10th sample from the training, compresses the held-out
+//  samples one by one without and with the dictionary/model and prints the sizes.
+//  Every result is checked by decompression; a mismatch makes exit code 1.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include <LzmaLib/LzmaLib.h>
+
+namespace {
+
+typedef std::vector<unsigned char> Buffer;
+
+struct Options
+{
+    const char *out;
+    const char *modelOut;
+    unsigned modelId;
+    size_t maxSize;
+    unsigned segmentSize;
+    int level;
+    bool lines;
+    bool test;
+    std::vector<const char *> files;
+
+    Options() : out(0), modelOut(0), modelId(1), maxSize(1 << 16), segmentSize(0), level(5), lines(false), test(false) {}
+};
+
+// ---------------------------------------------------------------------------
+// Samples
+
+struct Samples
+{
+    Buffer data;
+    std::vector<size_t> sizes;
+
+    void add(const unsigned char *p, size_t size)
+    {
+        data.insert(data.end(), p, p + size);
+        sizes.push_back(size);
+    }
+};
+
+bool readFile(const char *name, Buffer &buf)
+{
+    FILE *f = fopen(name, "rb");
+    if (!f)
+    {
+        perror(name);
+        return false;
+    }
+    unsigned char chunk[1 << 16];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) != 0)
+        buf.insert(buf.end(), chunk, chunk + n);
+    bool ok = !ferror(f);
+    if (!ok)
+        perror(name);
+    fclose(f);
+    return ok;
+}
+
+bool loadSamples(const Options &opt, std::vector<Buffer> &samples)
+{
+    for (size_t i = 0; i < opt.files.size(); i++)
+    {
+        Buffer buf;
+        if (!readFile(opt.files[i], buf))
+            return false;
+        if (!opt.lines)
+        {
+            samples.push_back(buf);
+            continue;
+        }
+        size_t start = 0;
+        for (size_t k = 0; k <= buf.size(); k++)
+            if (k == buf.size() || buf[k] == '\n')
+            {
+                size_t end = (k == buf.size()) ? k : k + 1;
+                if (end - start > 1)
+                    samples.push_back(Buffer(buf.begin() + start, buf.begin() + end));
+                start = end;
+            }
+    }
+    return true;
+}
+
+bool writeFile(const char *name, const Buffer &buf)
+{
+    FILE *f = fopen(name, "wb");
+    if (!f)
+    {
+        perror(name);
+        return false;
+    }
+    bool ok = buf.empty() || fwrite(&buf[0], 1, buf.size(), f) == buf.size();
+    if (fclose(f) != 0 || !ok)
+    {
+        perror(name);
+        return false;
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Test
+
+enum Mode { kPlain, kDict, kModel };
+
+size_t compress(const Buffer &src, Mode mode, const Buffer &dict, LzmaModel model, int level, bool &ok)
+{
+    Buffer packed(LzmaCompressBound(src.size()) + 1);
+    size_t packedLen = packed.size();
+    unsigned char props[LZMA_MODEL_PROPS_SIZE];
+    size_t propsSize = sizeof(props);
+    const unsigned char *s = src.empty() ? props : &src[0];
+    const unsigned char *d = dict.empty() ? props : &dict[0];
+    int res;
+    if (mode == kDict)
+        res = LzmaCompressWithDict(NULL, &packed[0], &packedLen, s, src.size(), d, dict.size(),
+            props, &propsSize, level, 0, -1, -1, -1, -1, 1);
+    else if (mode == kModel)
+        res = LzmaCompressWithModel(NULL, &packed[0], &packedLen, s, src.size(), model,
+            props, &propsSize, level, 0, -1, 1);
+    else
+        res = LzmaCompress(&packed[0], &packedLen, s, src.size(), props, &propsSize, level, 0, -1, -1, -1, -1, 1);
+    if (res != SZ_OK)
+    {
+        ok = false;
+        return 0;
+    }
+
+    Buffer unpacked(src.size() + 1);
+    size_t unpackedLen = src.size();
+    SizeT inLen = packedLen;
+    if (mode == kDict)
+        res = LzmaUncompressWithDict(NULL, &unpacked[0], &unpackedLen, &packed[0], &inLen,
+            d, dict.size(), props, propsSize);
+    else if (mode == kModel)
+        res = LzmaUncompressWithModel(NULL, &unpacked[0], &unpackedLen, &packed[0], &inLen,
+            model, props, propsSize);
+    else
+        res = LzmaUncompress(&unpacked[0], &unpackedLen, &packed[0], &inLen, props, propsSize);
+    if (res != SZ_OK || unpackedLen != src.size() || (!src.empty() && memcmp(&unpacked[0], &src[0], src.size()) != 0))
+        ok = false;
+    return packedLen + propsSize;
+}
+
+// ---------------------------------------------------------------------------
+// Command line
+
+size_t parseSize(const std::string &s)
+{
+    char *end;
+    size_t v = (size_t)strtoul(s.c_str(), &end, 10);
+    if (*end == 'K' || *end == 'k')
+        v <<= 10;
+    else if (*end == 'M' || *end == 'm')
+        v <<= 20;
+    else if (*end == 'G' || *end == 'g')
+        v <<= 30;
+    return v;
+}
+
+bool parseOptions(int argc, char **argv, Options &opt)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string name = argv[i];
+        if (name == "--lines") { opt.lines = true; continue; }
+        if (name == "--test") { opt.test = true; continue; }
+        if (name.compare(0, 1, "-") != 0)
+        {
+            opt.files.push_back(argv[i]);
+            continue;
+        }
+        if (i + 1 >= argc)
+            return false;
+        const char *value = argv[++i];
+        if (name == "-o") opt.out = value;
+        else if (name == "-m") opt.modelOut = value;
+        else if (name == "--model-id") opt.modelId = (unsigned)strtoul(value, NULL, 0);
+        else if (name == "--max-size") opt.maxSize = parseSize(value);
+        else if (name == "--segment") opt.segmentSize = (unsigned)atoi(value);
+        else if (name == "--level") opt.level = atoi(value);
+        else
+            return false;
+    }
+    return (opt.out || opt.modelOut) && opt.maxSize != 0 && !opt.files.empty();
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    Options opt;
+    if (!parseOptions(argc, argv, opt))
+    {
+        fprintf(stderr, "Usage: %s [-o dict.bin] [-m model.bin] [--model-id 1] [--max-size 64K]\n"
+                        "       [--segment 256] [--lines] [--level 5] [--test] files...\n", argv[0]);
+        return 2;
+    }
+
+    std::vector<Buffer> samples;
+    if (!loadSamples(opt, samples))
+        return 2;
+
+    Samples train, test;
+    for (size_t i = 0; i < samples.size(); i++)
+    {
+        Samples &dest = (opt.test && i % 10 == 9) ? test : train;
+        dest.add(samples[i].empty() ? NULL : &samples[i][0], samples[i].size());
+    }
+
+    const unsigned char *data = train.data.empty() ? NULL : &train.data[0];
+    const size_t *sizes = train.sizes.empty() ? NULL : &train.sizes[0];
+    printf("samples: %lu (%lu bytes)\n", (unsigned long)train.sizes.size(), (unsigned long)train.data.size());
+
+    Buffer dict, model;
+    if (opt.out)
+    {
+        dict.resize(opt.maxSize);
+        size_t dictLen = dict.size();
+        int res = LzmaTrainDict(&dict[0], &dictLen, data, sizes, (unsigned)train.sizes.size(), opt.segmentSize);
+        if (res != SZ_OK)
+        {
+            fprintf(stderr, "LzmaTrainDict error: %d\n", res);
+            return 1;
+        }
+        dict.resize(dictLen);
+        if (!writeFile(opt.out, dict))
+            return 1;
+        printf("dictionary: %lu bytes\n", (unsigned long)dict.size());
+    }
+    if (opt.modelOut)
+    {
+        model.resize(LzmaModelSize(3, 0));
+        size_t modelSize = model.size();
+        int res = LzmaTrainModel(&model[0], &modelSize, opt.modelId, data, sizes, (unsigned)train.sizes.size(),
+            opt.level, -1, -1, -1);
+        if (res != SZ_OK)
+        {
+            fprintf(stderr, "LzmaTrainModel error: %d\n", res);
+            return 1;
+        }
+        model.resize(modelSize);
+        if (!writeFile(opt.modelOut, model))
+            return 1;
+        printf("model: %lu bytes, id %u\n", (unsigned long)model.size(), opt.modelId);
+    }
+
+    if (!opt.test)
+        return 0;
+    LzmaModel loaded = NULL;
+    if (opt.modelOut)
+    {
+        int res = LzmaModelLoad(&loaded, &model[0], model.size());
+        if (res != SZ_OK)
+        {
+            fprintf(stderr, "LzmaModelLoad error: %d\n", res);
+            return 1;
+        }
+    }
+    size_t packed[3] = { 0, 0, 0 };
+    bool ok = true;
+    for (size_t i = 9; i < samples.size(); i += 10)
+    {
+        packed[kPlain] += compress(samples[i], kPlain, dict, loaded, opt.level, ok);
+        if (opt.out)
+            packed[kDict] += compress(samples[i], kDict, dict, loaded, opt.level, ok);
+        if (opt.modelOut)
+            packed[kModel] += compress(samples[i], kModel, dict, loaded, opt.level, ok);
+    }
+    printf("test: %lu samples (%lu bytes), packed: %lu bytes\n",
+        (unsigned long)test.sizes.size(), (unsigned long)test.data.size(), (unsigned long)packed[kPlain]);
+    if (opt.out)
+        printf("  with dictionary: %lu bytes (%.1f%%)\n",
+            (unsigned long)packed[kDict], packed[kPlain] ? 100.0 * packed[kDict] / packed[kPlain] : 100.0);
+    if (opt.modelOut)
+        printf("  with model: %lu bytes (%.1f%%)\n",
+            (unsigned long)packed[kModel], packed[kPlain] ? 100.0 * packed[kModel] / packed[kPlain] : 100.0);
+    LzmaModelFree(loaded);
+    if (!ok)
+        fprintf(stderr, "Error: test round trip failed\n");
+    return ok ? 0 : 1;
+}